@@ -0,0 +1,366 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#include "fru.hpp"
+
+#include "config.hpp"
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <unordered_map>
+
+/** @brief Size of the common header and multiplier of area offsets. */
+static constexpr size_t fruBlockSize = 8;
+/** @brief Type/length byte of the end of fields marker. */
+static constexpr uint8_t fruEndOfFields = 0xc1;
+
+/** @brief FRU info areas in order of the common header. */
+enum class FruArea
+{
+    chassis = 2,
+    board = 3,
+    product = 4,
+};
+
+/**
+ * @brief Check zero checksum of the data block.
+ *
+ * @param[in] data pointer to the block
+ * @param[in] size size of the block
+ *
+ * @return true if checksum is valid
+ */
+static bool checkSum(const uint8_t* data, size_t size)
+{
+    uint8_t sum = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        sum += data[i];
+    }
+    return sum == 0;
+}
+
+/**
+ * @brief Decode type/length encoded field.
+ *
+ * @param[in] data pointer to the field data
+ * @param[in] type field type
+ * @param[in] len field length
+ *
+ * @return decoded field, trailing spaces are stripped by the caller
+ */
+static std::string decodeField(const uint8_t* data, uint8_t type, size_t len)
+{
+    std::string str;
+    switch (type)
+    {
+        case 0: // binary
+        {
+            static const char* hex = "0123456789abcdef";
+            for (size_t i = 0; i < len; ++i)
+            {
+                str += hex[data[i] >> 4];
+                str += hex[data[i] & 0x0f];
+            }
+            break;
+        }
+        case 1: // BCD plus
+        {
+            static const char* bcdPlus = "0123456789 -.???";
+            for (size_t i = 0; i < len; ++i)
+            {
+                str += bcdPlus[data[i] >> 4];
+                str += bcdPlus[data[i] & 0x0f];
+            }
+            break;
+        }
+        case 2: // 6-bit ASCII, packed
+        {
+            uint32_t bits = 0;
+            size_t bitsNum = 0;
+            for (size_t i = 0; i < len; ++i)
+            {
+                bits |= static_cast<uint32_t>(data[i]) << bitsNum;
+                bitsNum += 8;
+                while (bitsNum >= 6)
+                {
+                    str += static_cast<char>((bits & 0x3f) + 0x20);
+                    bits >>= 6;
+                    bitsNum -= 6;
+                }
+            }
+            break;
+        }
+        default: // 8-bit ASCII or Latin-1
+            str.assign(reinterpret_cast<const char*>(data), len);
+            break;
+    }
+    return str;
+}
+
+/**
+ * @brief Parse FRU info area.
+ *
+ * @param[in] data raw FRU image
+ * @param[in] area area type
+ * @param[in] offset area offset in bytes
+ * @param[out] properties parsed properties
+ */
+static void parseArea(const std::vector<uint8_t>& data, FruArea area,
+                      size_t offset, InventoryItem::Properties& properties)
+{
+    // clang-format off
+    static const std::vector<const char*> chassisFields = {
+        "PartNumber", "SerialNumber",
+    };
+    static const std::vector<const char*> boardFields = {
+        "Manufacturer", "PrettyName", "SerialNumber", "PartNumber",
+        nullptr, // FRU file ID
+    };
+    static const std::vector<const char*> productFields = {
+        "Manufacturer", "PrettyName", "Model", "Version", "SerialNumber",
+        "AssetTag",
+        nullptr, // FRU file ID
+    };
+    // clang-format on
+
+    if (offset + 2 > data.size())
+    {
+        return;
+    }
+    const size_t size = data[offset + 1] * fruBlockSize;
+    if (!size || offset + size > data.size() ||
+        !checkSum(&data[offset], size))
+    {
+        return;
+    }
+    const size_t end = offset + size;
+
+    // fixed part of the area: version, length, language or chassis type,
+    // board area also has manufacturing date
+    if (size < (area == FruArea::board ? 6 : 3))
+    {
+        return;
+    }
+    const std::vector<const char*>* fields = nullptr;
+    size_t pos = offset + 2;
+    switch (area)
+    {
+        case FruArea::chassis:
+            properties["ChassisType"] = data[pos];
+            pos += 1;
+            fields = &chassisFields;
+            break;
+        case FruArea::board:
+        {
+            // minutes since 1996-01-01 00:00 UTC, LSB first
+            const uint32_t minutes = data[pos + 1] |
+                                     (data[pos + 2] << 8) |
+                                     (data[pos + 3] << 16);
+            if (minutes)
+            {
+                static constexpr time_t epoch1996 = 820454400;
+                const time_t buildTime = epoch1996 + minutes * 60;
+                struct tm tm;
+                char buf[32];
+                gmtime_r(&buildTime, &tm);
+                strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+                properties["BuildDate"] = std::string(buf);
+            }
+            pos += 4;
+            fields = &boardFields;
+            break;
+        }
+        case FruArea::product:
+            pos += 1;
+            fields = &productFields;
+            break;
+    }
+
+    // type/length encoded fields, custom ones are ignored
+    InventoryItem::Properties areaProps;
+    for (const char* name : *fields)
+    {
+        if (pos >= end || data[pos] == fruEndOfFields)
+        {
+            break;
+        }
+        const uint8_t type = data[pos] >> 6;
+        const size_t len = data[pos] & 0x3f;
+        ++pos;
+        if (pos + len > end)
+        {
+            break;
+        }
+        if (name && len)
+        {
+            areaProps[name] = decodeField(&data[pos], type, len);
+        }
+        pos += len;
+    }
+
+    InventoryItem item;
+    item.merge(areaProps);
+    for (auto& [name, value] : item.properties)
+    {
+        if (!std::get<std::string>(value).empty())
+        {
+            properties[name] = std::move(value);
+        }
+    }
+}
+
+bool parseFru(const std::vector<uint8_t>& data,
+              InventoryItem::Properties& properties)
+{
+    if (data.size() < fruBlockSize || (data[0] & 0x0f) != 1 ||
+        !checkSum(data.data(), fruBlockSize))
+    {
+        return false;
+    }
+
+    // areas with lower precedence go first
+    for (FruArea area : {FruArea::chassis, FruArea::board, FruArea::product})
+    {
+        const size_t offset = data[static_cast<size_t>(area)] * fruBlockSize;
+        if (offset)
+        {
+            parseArea(data, area, offset, properties);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Read FRU image from EEPROM.
+ *
+ * Only the common header and info areas are read to reduce bus traffic.
+ *
+ * @param[in] file path to the EEPROM file
+ *
+ * @return FRU image, empty if file can not be read
+ */
+static std::vector<uint8_t> readFru(const std::string& file)
+{
+    std::ifstream stream(file, std::ios::binary);
+    std::vector<uint8_t> data(fruBlockSize);
+    if (!stream.read(reinterpret_cast<char*>(data.data()), data.size()))
+    {
+        return {};
+    }
+
+    // get the end of the last area
+    size_t end = fruBlockSize;
+    for (FruArea area : {FruArea::chassis, FruArea::board, FruArea::product})
+    {
+        const size_t offset = data[static_cast<size_t>(area)] * fruBlockSize;
+        char header[2];
+        if (offset && stream.seekg(offset) && stream.read(header, 2))
+        {
+            const size_t size = static_cast<uint8_t>(header[1]) * fruBlockSize;
+            end = std::max(end, offset + size);
+        }
+        stream.clear();
+    }
+
+    data.resize(end);
+    stream.seekg(0);
+    stream.read(reinterpret_cast<char*>(data.data()), data.size());
+    data.resize(stream.gcount());
+
+    return data;
+}
+
+/**
+ * @brief Get synthetic D-Bus path of the FRU item.
+ *
+ * @param[in] device name of the EEPROM device
+ *
+ * @return path under the inventory root
+ */
+static std::string fruPath(const std::string& device)
+{
+    // D-Bus path elements may contain [A-Za-z0-9_] only
+    std::string path = INVENTORY_PATH "/fru/";
+    for (const char ch : device)
+    {
+        path += isalnum(static_cast<unsigned char>(ch)) ? ch : '_';
+    }
+    return path;
+}
+
+std::vector<InventoryItem> getFruInventory(const std::string& dir)
+{
+    std::vector<std::string> devices;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec))
+    {
+        if (std::filesystem::exists(entry.path() / "eeprom", ec))
+        {
+            devices.emplace_back(entry.path().filename());
+        }
+    }
+
+    // reading over I2C is slow, read all EEPROMs in parallel
+    std::vector<std::future<std::vector<uint8_t>>> images;
+    images.reserve(devices.size());
+    for (const std::string& device : devices)
+    {
+        images.emplace_back(std::async(std::launch::async, readFru,
+                                       dir + '/' + device + "/eeprom"));
+    }
+
+    std::vector<InventoryItem> items;
+    for (size_t i = 0; i < devices.size(); ++i)
+    {
+        InventoryItem item;
+        if (parseFru(images[i].get(), item.properties))
+        {
+            item.name = "fru-" + devices[i];
+            item.path = fruPath(devices[i]);
+            items.emplace_back(std::move(item));
+        }
+    }
+
+    return items;
+}
+
+void mergeFruInventory(std::vector<InventoryItem>& items,
+                       std::vector<InventoryItem>&& fru)
+{
+    std::unordered_map<std::string, size_t> bySerial;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        const auto it = items[i].properties.find("SerialNumber");
+        if (it != items[i].properties.end())
+        {
+            const std::string* serial = std::get_if<std::string>(&it->second);
+            if (serial && !serial->empty())
+            {
+                bySerial.emplace(*serial, i);
+            }
+        }
+    }
+
+    for (InventoryItem& fruItem : fru)
+    {
+        auto match = bySerial.end();
+        const auto it = fruItem.properties.find("SerialNumber");
+        if (it != fruItem.properties.end())
+        {
+            match = bySerial.find(std::get<std::string>(it->second));
+        }
+        if (match == bySerial.end())
+        {
+            items.emplace_back(std::move(fruItem));
+        }
+        else
+        {
+            items[match->second].properties.insert(fruItem.properties.begin(),
+                                                   fruItem.properties.end());
+        }
+    }
+}
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#pragma once
+
+#include "inventory.hpp"
+
+#include <cstdint>
+
+/**
+ * @brief Parse IPMI FRU image.
+ *
+ * Chassis, board and product info areas are converted to the properties
+ * named as on D-Bus (Manufacturer, PrettyName, SerialNumber, etc). If the
+ * same property is set by several areas, product area has precedence over
+ * board one, and board area has precedence over chassis one.
+ *
+ * @param[in] data raw FRU image
+ * @param[out] properties parsed properties
+ *
+ * @return false if the image has no valid common header
+ */
+bool parseFru(const std::vector<uint8_t>& data,
+              InventoryItem::Properties& properties);
+
+/**
+ * @brief Get inventory items from FRU EEPROMs.
+ *
+ * EEPROMs are expected at DIR/DEVICE/eeprom, as exposed by the kernel under
+ * /sys/bus/i2c/devices. All the devices are read in parallel, the ones
+ * without valid FRU image are skipped. Items are named fru-DEVICE and get
+ * synthetic D-Bus path INVENTORY_PATH/fru/DEVICE.
+ *
+ * @param[in] dir directory with EEPROM devices
+ *
+ * @return array with inventory items
+ */
+std::vector<InventoryItem> getFruInventory(const std::string& dir);
+
+/**
+ * @brief Merge FRU items into the inventory.
+ *
+ * FRU item is merged into the inventory item with the same serial number,
+ * only properties missing in the inventory item are added. Other FRU items
+ * are appended to the inventory.
+ *
+ * @param[in,out] items inventory items
+ * @param[in] fru FRU items
+ */
+void mergeFruInventory(std::vector<InventoryItem>& items,
+                       std::vector<InventoryItem>&& fru);
@@ -0,0 +1,604 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#include "history.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+/** @brief D-Bus type codes of the property value alternatives. */
+static constexpr const char* valueTypes = "xtuqysb";
+static_assert(std::variant_size_v<InventoryItem::PropValue> == 7);
+
+/**
+ * @brief Split record into tab separated fields.
+ *
+ * @param[in] line record to split
+ *
+ * @return array of fields
+ */
+static std::vector<std::string> split(const std::string& line)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true)
+    {
+        const size_t end = line.find('\t', start);
+        fields.emplace_back(line.substr(start, end - start));
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        start = end + 1;
+    }
+    return fields;
+}
+
+/**
+ * @brief Parse header of the checkpoint or delta record group.
+ *
+ * @param[in] line record to parse
+ * @param[out] timestamp timestamp of the group
+ *
+ * @return false if the record is not a valid group header
+ */
+static bool parseHeader(const std::string& line, time_t& timestamp)
+{
+    if (line.length() < 3 || (line[0] != 'C' && line[0] != 'D') ||
+        line[1] != '\t')
+    {
+        return false;
+    }
+    char* end = nullptr;
+    const long long ts = strtoll(line.c_str() + 2, &end, 10);
+    if (*end)
+    {
+        return false;
+    }
+    timestamp = static_cast<time_t>(ts);
+    return true;
+}
+
+/**
+ * @brief Get key of the item in inventory state.
+ *
+ * @param[in] item inventory item
+ *
+ * @return item's path, or name for items without path
+ */
+static const std::string& itemKey(const InventoryItem& item)
+{
+    return item.path.empty() ? item.name : item.path;
+}
+
+/**
+ * @class RecordWriter
+ * @brief Writer of history records with path compaction.
+ */
+class RecordWriter
+{
+  public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[out] out output buffer
+     */
+    explicit RecordWriter(std::string& out) : out(out)
+    {}
+
+    /**
+     * @brief Write item record with all properties.
+     *
+     * @param[in] item inventory item
+     */
+    void add(const InventoryItem& item)
+    {
+        begin('+', itemKey(item));
+        out += '\t';
+        out += escape(item.name);
+        out += '\n';
+        for (const auto& [name, value] : item.properties)
+        {
+            set(itemKey(item), name, value);
+        }
+    }
+
+    /**
+     * @brief Write item removal record.
+     *
+     * @param[in] path item's path
+     */
+    void remove(const std::string& path)
+    {
+        begin('-', path);
+        out += '\n';
+    }
+
+    /**
+     * @brief Write property record.
+     *
+     * @param[in] path item's path
+     * @param[in] name property name
+     * @param[in] value property value
+     */
+    void set(const std::string& path, const std::string& name,
+             const InventoryItem::PropValue& value)
+    {
+        begin('=', path);
+        out += '\t';
+        out += escape(name);
+        out += '\t';
+        out += encodeValue(value);
+        out += '\n';
+    }
+
+    /**
+     * @brief Write property removal record.
+     *
+     * @param[in] path item's path
+     * @param[in] name property name
+     */
+    void unset(const std::string& path, const std::string& name)
+    {
+        begin('~', path);
+        out += '\t';
+        out += escape(name);
+        out += '\n';
+    }
+
+  private:
+    /**
+     * @brief Write record type and path, skip path if it's not changed.
+     */
+    void begin(char type, const std::string& path)
+    {
+        out += type;
+        out += '\t';
+        if (path != lastPath)
+        {
+            out += escape(path);
+            lastPath = path;
+        }
+    }
+
+    /** @brief Output buffer. */
+    std::string& out;
+    /** @brief Path of the last record. */
+    std::string lastPath;
+};
+
+/**
+ * @class LockedFile
+ * @brief History file opened for writing with exclusive lock.
+ */
+class LockedFile
+{
+  public:
+    /**
+     * @brief Constructor, waits for the lock.
+     *
+     * @param[in] file path to the file, created if it doesn't exist
+     *
+     * @throw std::runtime_error if the file can not be opened or locked
+     */
+    explicit LockedFile(const std::string& file) :
+        file(file), fd(open(file.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644))
+    {
+        if (fd == -1)
+        {
+            throw std::runtime_error("Unable to open history file " + file);
+        }
+        if (flock(fd, LOCK_EX) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Unable to lock history file " + file);
+        }
+    }
+
+    ~LockedFile()
+    {
+        close(fd);
+    }
+
+    LockedFile(const LockedFile&) = delete;
+    LockedFile& operator=(const LockedFile&) = delete;
+
+    /**
+     * @brief Replace the file content starting from specified offset.
+     *
+     * @param[in] offset offset to write data at, the file is truncated here
+     * @param[in] data data to write
+     *
+     * @throw std::runtime_error on I/O errors
+     */
+    void write(std::streamoff offset, const std::string& data)
+    {
+        if (ftruncate(fd, offset) != 0 || lseek(fd, offset, SEEK_SET) < 0)
+        {
+            throw std::runtime_error("Unable to write history file " + file);
+        }
+        size_t written = 0;
+        while (written < data.size())
+        {
+            const ssize_t rc =
+                ::write(fd, data.data() + written, data.size() - written);
+            if (rc < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (rc <= 0)
+            {
+                throw std::runtime_error("Unable to write history file " +
+                                         file);
+            }
+            written += static_cast<size_t>(rc);
+        }
+    }
+
+  private:
+    /** @brief Path to the file. */
+    const std::string& file;
+    /** @brief File descriptor. */
+    const int fd;
+};
+
+History::History(const std::string& file) : file(file)
+{}
+
+size_t History::record(const std::vector<InventoryItem>& items,
+                       time_t timestamp)
+{
+    const std::filesystem::path dir = std::filesystem::path(file).parent_path();
+    if (!dir.empty())
+    {
+        std::filesystem::create_directories(dir);
+    }
+
+    // concurrent recorders must not interleave their replays and appends
+    LockedFile lockedFile(file);
+
+    State last;
+    std::streamoff committed = 0;
+    const size_t deltas =
+        replay(std::numeric_limits<time_t>::max(), last, committed);
+
+    State current;
+    for (const InventoryItem& item : items)
+    {
+        InventoryItem& stored = current[itemKey(item)];
+        stored.name = item.name;
+        stored.path = itemKey(item);
+        for (const auto& [name, value] : item.properties)
+        {
+            stored.properties[name] = value;
+        }
+    }
+
+    // build delta against the last state
+    std::string delta;
+    RecordWriter writer(delta);
+    size_t changes = 0;
+    for (const auto& [path, _] : last)
+    {
+        if (current.find(path) == current.end())
+        {
+            writer.remove(path);
+            ++changes;
+        }
+    }
+    for (const auto& [path, item] : current)
+    {
+        const auto it = last.find(path);
+        if (it == last.end() || it->second.name != item.name)
+        {
+            writer.add(item);
+            ++changes;
+            continue;
+        }
+
+        const InventoryItem::Properties& lastProps = it->second.properties;
+        bool changed = false;
+        for (const auto& [name, _] : lastProps)
+        {
+            if (item.properties.find(name) == item.properties.end())
+            {
+                writer.unset(path, name);
+                changed = true;
+            }
+        }
+        for (const auto& [name, value] : item.properties)
+        {
+            const auto prop = lastProps.find(name);
+            if (prop == lastProps.end() || prop->second != value)
+            {
+                writer.set(path, name, value);
+                changed = true;
+            }
+        }
+        changes += changed;
+    }
+
+    if (!changes)
+    {
+        return 0;
+    }
+
+    std::string out;
+    if (deltas >= CheckpointInterval)
+    {
+        out = "C\t" + std::to_string(timestamp) + '\n';
+        RecordWriter checkpoint(out);
+        for (const auto& [_, item] : current)
+        {
+            checkpoint.add(item);
+        }
+    }
+    else
+    {
+        out = "D\t" + std::to_string(timestamp) + '\n' + delta;
+    }
+    out += '\n'; // commit the group
+
+    // uncommitted tail is left by interrupted write, drop it
+    lockedFile.write(committed, out);
+
+    return changes;
+}
+
+std::vector<InventoryItem> History::at(time_t timestamp) const
+{
+    if (!std::ifstream(file))
+    {
+        throw std::runtime_error("Unable to read history file " + file);
+    }
+
+    State state;
+    std::streamoff committed = 0;
+    replay(timestamp, state, committed);
+
+    std::vector<InventoryItem> items;
+    items.reserve(state.size());
+    for (auto& [_, item] : state)
+    {
+        items.emplace_back(std::move(item));
+    }
+    return items;
+}
+
+size_t History::replay(time_t timestamp, State& state,
+                       std::streamoff& committed) const
+{
+    state.clear();
+    committed = 0;
+
+    std::ifstream stream(file);
+    if (!stream)
+    {
+        return CheckpointInterval;
+    }
+
+    // find the nearest checkpoint and the end of the last committed group,
+    // groups without terminating empty line were interrupted and ignored
+    std::streamoff checkpoint = -1;
+    std::streamoff groupStart = -1;
+    std::streamoff committedEnd = 0;
+    bool isCheckpoint = false;
+    std::streamoff pos = stream.tellg();
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        const bool complete = !stream.eof();
+        time_t ts;
+        if (parseHeader(line, ts))
+        {
+            if (ts > timestamp)
+            {
+                break;
+            }
+            groupStart = pos;
+            isCheckpoint = line[0] == 'C';
+        }
+        else if (line.empty() && complete && groupStart >= 0)
+        {
+            if (isCheckpoint)
+            {
+                checkpoint = groupStart;
+            }
+            groupStart = -1;
+            committedEnd = stream.tellg();
+        }
+        pos = stream.tellg();
+    }
+
+    committed = committedEnd;
+    if (checkpoint < 0)
+    {
+        return CheckpointInterval;
+    }
+
+    // replay committed records after the checkpoint
+    stream.clear();
+    stream.seekg(checkpoint);
+    size_t deltas = 0;
+    std::string path;
+    while (stream.tellg() < committedEnd && std::getline(stream, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+        time_t ts;
+        if (parseHeader(line, ts))
+        {
+            if (line[0] == 'C')
+            {
+                state.clear();
+                deltas = 0;
+            }
+            else
+            {
+                ++deltas;
+            }
+            continue;
+        }
+
+        const std::vector<std::string> fields = split(line);
+        if (fields.size() < 2 || fields[0].length() != 1)
+        {
+            throw std::runtime_error("Invalid history record: " + line);
+        }
+        if (!fields[1].empty())
+        {
+            path = unescape(fields[1]);
+        }
+        switch (fields[0][0])
+        {
+            case '+':
+                if (fields.size() == 3)
+                {
+                    InventoryItem& item = state[path];
+                    item.name = unescape(fields[2]);
+                    item.path = path;
+                    item.properties.clear();
+                    continue;
+                }
+                break;
+            case '-':
+                if (fields.size() == 2)
+                {
+                    state.erase(path);
+                    continue;
+                }
+                break;
+            case '=':
+                if (fields.size() == 4)
+                {
+                    state[path].properties[unescape(fields[2])] =
+                        decodeValue(fields[3]);
+                    continue;
+                }
+                break;
+            case '~':
+                if (fields.size() == 3)
+                {
+                    state[path].properties.erase(unescape(fields[2]));
+                    continue;
+                }
+                break;
+        }
+        throw std::runtime_error("Invalid history record: " + line);
+    }
+
+    return deltas;
+}
+
+std::string escape(const std::string& str)
+{
+    std::string escaped;
+    escaped.reserve(str.length());
+    for (const char ch : str)
+    {
+        switch (ch)
+        {
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\t':
+                escaped += "\\t";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            default:
+                escaped += ch;
+        }
+    }
+    return escaped;
+}
+
+std::string unescape(const std::string& str)
+{
+    std::string unescaped;
+    unescaped.reserve(str.length());
+    for (size_t i = 0; i < str.length(); ++i)
+    {
+        if (str[i] != '\\' || i + 1 == str.length())
+        {
+            unescaped += str[i];
+            continue;
+        }
+        switch (str[++i])
+        {
+            case 't':
+                unescaped += '\t';
+                break;
+            case 'n':
+                unescaped += '\n';
+                break;
+            default:
+                unescaped += str[i];
+        }
+    }
+    return unescaped;
+}
+
+std::string encodeValue(const InventoryItem::PropValue& value)
+{
+    std::string str(1, valueTypes[value.index()]);
+    std::visit(
+        [&str](auto&& arg) {
+            using T = std::decay_t<decltype(arg)>;
+            if constexpr (std::is_same_v<T, bool>)
+                str += arg ? '1' : '0';
+            else if constexpr (std::is_arithmetic<T>::value)
+                str += std::to_string(arg);
+            else if constexpr (std::is_same_v<T, std::string>)
+                str += escape(arg);
+            else
+                static_assert(T::value, "Unhandled value type");
+        },
+        value);
+    return str;
+}
+
+InventoryItem::PropValue decodeValue(const std::string& str)
+{
+    if (str.empty())
+    {
+        throw std::runtime_error("Empty property value");
+    }
+
+    const std::string val = str.substr(1);
+    try
+    {
+        switch (str[0])
+        {
+            case 'x':
+                return static_cast<int64_t>(std::stoll(val));
+            case 't':
+                return static_cast<uint64_t>(std::stoull(val));
+            case 'u':
+                return static_cast<uint32_t>(std::stoul(val));
+            case 'q':
+                return static_cast<uint16_t>(std::stoul(val));
+            case 'y':
+                return static_cast<uint8_t>(std::stoul(val));
+            case 's':
+                return unescape(val);
+            case 'b':
+                return val == "1";
+        }
+    }
+    catch (const std::logic_error&)
+    {
+        // invalid number
+    }
+    throw std::runtime_error("Invalid property value: " + str);
+}
@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#pragma once
+
+#include "inventory.hpp"
+
+#include <ctime>
+#include <ios>
+
+/**
+ * @class History
+ * @brief Append-only inventory history file.
+ *
+ * The file is a sequence of text records. A checkpoint contains the full
+ * inventory state, a delta contains only changes against the previous
+ * state. Both of them start with a timestamp line:
+ *   C<TAB>timestamp            checkpoint
+ *   D<TAB>timestamp            delta
+ * followed by item records
+ *   +<TAB>path<TAB>name        item added (or reset)
+ *   -<TAB>path                 item removed
+ *   =<TAB>path<TAB>prop<TAB>v  property set
+ *   ~<TAB>path<TAB>prop        property removed
+ * and terminated by an empty line. Empty path refers to the path of the
+ * previous record. Property values are prefixed with D-Bus type code.
+ *
+ * Checkpoints and deltas without terminating empty line are left by
+ * interrupted writes, they are ignored on reading and dropped by the next
+ * record. Recording is serialized with exclusive lock of the file.
+ */
+class History
+{
+  public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] file path to the history file
+     */
+    explicit History(const std::string& file);
+
+    /**
+     * @brief Record inventory state.
+     *
+     * Only changes against the last recorded state are written, every
+     * CheckpointInterval-th record is a full checkpoint.
+     *
+     * @param[in] items current inventory items
+     * @param[in] timestamp time of the state
+     *
+     * @return number of changed items
+     *
+     * @throw std::runtime_error on I/O errors
+     */
+    size_t record(const std::vector<InventoryItem>& items, time_t timestamp);
+
+    /**
+     * @brief Rebuild inventory state at specified time.
+     *
+     * The state is replayed from the nearest preceding checkpoint.
+     *
+     * @param[in] timestamp point in time
+     *
+     * @return inventory items, empty if nothing was recorded before
+     *
+     * @throw std::runtime_error if the file doesn't exist or malformed
+     */
+    std::vector<InventoryItem> at(time_t timestamp) const;
+
+    /** @brief Number of deltas between checkpoints. */
+    static constexpr size_t CheckpointInterval = 32;
+
+  private:
+    /** @brief Inventory state: items by their paths. */
+    using State = std::map<std::string, InventoryItem>;
+
+    /**
+     * @brief Replay history up to specified time.
+     *
+     * @param[in] timestamp point in time
+     * @param[out] state inventory state
+     * @param[out] committed end offset of the last replayed group
+     *
+     * @return number of deltas after the last checkpoint, or
+     *         CheckpointInterval if there is no checkpoint
+     *
+     * @throw std::runtime_error on malformed committed records
+     */
+    size_t replay(time_t timestamp, State& state,
+                  std::streamoff& committed) const;
+
+    /** @brief Path to the history file. */
+    std::string file;
+};
+
+/**
+ * @brief Escape tabs, new lines and backslashes.
+ *
+ * @param[in] str string to escape
+ *
+ * @return escaped string
+ */
+std::string escape(const std::string& str);
+
+/**
+ * @brief Unescape string encoded by escape().
+ *
+ * @param[in] str string to unescape
+ *
+ * @return original string
+ */
+std::string unescape(const std::string& str);
+
+/**
+ * @brief Encode property value as its D-Bus type code followed by the value.
+ *
+ * @param[in] value property value
+ *
+ * @return encoded value, safe to use as a tab separated field
+ */
+std::string encodeValue(const InventoryItem::PropValue& value);
+
+/**
+ * @brief Decode property value encoded by encodeValue().
+ *
+ * @param[in] str encoded value
+ *
+ * @return property value
+ *
+ * @throw std::runtime_error if the value is malformed
+ */
+InventoryItem::PropValue decodeValue(const std::string& str);
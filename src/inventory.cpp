@@ -4,8 +4,10 @@
 #include "inventory.hpp"
 
 #include "config.hpp"
+#include "sorter.hpp"
+#include "tree.hpp"
 
-#include <unordered_set>
+#include <optional>
 
 /**
  * @brief Construct item name from its path.
@@ -41,21 +43,10 @@ static std::string nameFromPath(const std::string& path)
     }
 }
 
-/**
- * @brief Comparator for human sorting of inventory items.
- *
- * Comparsion based on digits inside the name:
- * cpu1/core2 is less than cpu1/core10, but grater than cpu0/core10.
- *
- * @param[in] a first item to compare
- * @param[in] b second item to compare
- *
- * @return comparsion result, true if a < b
- */
-static bool humanCompare(const InventoryItem& a, const InventoryItem& b)
+bool humanCompare(const std::string& a, const std::string& b)
 {
-    const char* strA = a.name.c_str();
-    const char* strB = b.name.c_str();
+    const char* strA = a.c_str();
+    const char* strB = b.c_str();
     while (true)
     {
         const char& chrA = *strA;
@@ -134,52 +125,217 @@ void InventoryItem::merge(InventoryItem::Properties& props)
     }
 }
 
-std::vector<InventoryItem> getInventory(sdbusplus::bus::bus& bus)
+/**
+ * @brief Check if the path belongs to the subtree.
+ *
+ * @param[in] path D-Bus path to check
+ * @param[in] root root path of the subtree
+ *
+ * @return true if path is the root or one of its descendants
+ */
+static bool isUnder(const std::string& path, const std::string& root)
 {
-    std::vector<InventoryItem> items;
+    if (root.empty() || root == "/")
+    {
+        return true;
+    }
+    return path.compare(0, root.length(), root) == 0 &&
+           (path.length() == root.length() || path[root.length()] == '/');
+}
 
+#ifdef USE_VEGMAN_HACK
+/**
+ * @brief Get names of the services available on the bus.
+ *
+ * @param[in] bus D-Bus instance
+ *
+ * @return set of running and activatable service names
+ */
+static std::unordered_set<std::string> getBusNames(sdbusplus::bus::bus& bus)
+{
+    std::unordered_set<std::string> names;
+    for (const char* method : {"ListNames", "ListActivatableNames"})
+    {
+        auto list = bus.new_method_call("org.freedesktop.DBus",
+                                        "/org/freedesktop/DBus",
+                                        "org.freedesktop.DBus", method);
+        std::vector<std::string> reply;
+        bus.call(list).read(reply);
+        names.insert(reply.begin(), reply.end());
+    }
+    return names;
+}
+#endif
+
+/**
+ * @brief Pass items to the handler in specified order.
+ *
+ * @param[in] items array of items to pass
+ * @param[in] order order of items
+ * @param[in] handler callback for inventory items
+ */
+static void passOrdered(std::vector<InventoryItem>& items,
+                        InventoryOptions::Order order,
+                        const InventoryHandler& handler)
+{
+    sortInventory(items, order);
+    for (InventoryItem& item : items)
+    {
+        handler(item);
+    }
+}
+
+std::string subtreeRoot(const std::string& path)
+{
+    const size_t end = path.find_last_not_of('/');
+    return end == std::string::npos ? std::string() : path.substr(0, end + 1);
+}
+
+std::vector<InventoryService>
+    selectServices(const std::vector<InventoryService>& services,
+                   const std::unordered_set<std::string>& busNames,
+                   const InventoryOptions& options)
+{
+    std::vector<InventoryService> selected;
+    for (const auto& [service, rootpath] : services)
+    {
+        if (busNames.find(service) == busNames.end())
+        {
+            if (options.verbose)
+            {
+                fprintf(stderr, "Skip absent service %s\n", service.c_str());
+            }
+            continue;
+        }
+
+        // object managers can't be queried for a subtree, so skip
+        // unrelated services and filter out objects by path
+        if (!isUnder(options.root, rootpath) &&
+            !isUnder(rootpath, options.root))
+        {
+            continue;
+        }
+
+        if (options.verbose)
+        {
+            fprintf(stderr, "Query service %s\n", service.c_str());
+        }
+        selected.emplace_back(service, rootpath);
+    }
+    return selected;
+}
+
+void sortInventory(std::vector<InventoryItem>& items,
+                   InventoryOptions::Order order)
+{
+    switch (order)
+    {
+        case InventoryOptions::Order::path:
+        {
+            InventoryTree tree;
+            for (InventoryItem& item : items)
+            {
+                tree.add(std::move(item));
+            }
+            items.clear();
+            tree.walk([&items](InventoryItem& item) {
+                items.emplace_back(std::move(item));
+            });
+            break;
+        }
+        case InventoryOptions::Order::name:
+            std::sort(items.begin(), items.end(),
+                      [](const InventoryItem& a, const InventoryItem& b) {
+                          return humanCompare(a.name, b.name);
+                      });
+            break;
+        case InventoryOptions::Order::none:
+            break;
+    }
+}
+
+void getInventory(sdbusplus::bus::bus& bus, const InventoryOptions& options,
+                  const InventoryHandler& handler)
+{
 #ifndef USE_VEGMAN_HACK
+    // mapper doesn't return the object at the requested root, so query
+    // the root's parent to get the root item itself
+    std::string root = INVENTORY_PATH;
+    if (!options.root.empty())
+    {
+        const size_t parent = options.root.rfind('/');
+        root = parent ? options.root.substr(0, parent) : "/";
+    }
+
     // get all inventory items
     auto subTree = bus.new_method_call(MAPPER_SERVICE, MAPPER_PATH,
                                        MAPPER_IFACE, "GetSubTree");
     const std::vector<std::string> ifaces = {INVENTORY_IFACE};
-    subTree.append(INVENTORY_PATH, 0, ifaces);
+    subTree.append(root, 0, ifaces);
     std::map<std::string, std::map<std::string, std::vector<std::string>>>
         subTreeObjects;
     bus.call(subTree).read(subTreeObjects);
 
-    for (const auto& [path, objects] : subTreeObjects)
+    // names and paths are known before reading properties, so order
+    // the objects first and read properties item by item
+    std::vector<InventoryItem> items;
+    items.reserve(subTreeObjects.size());
+    for (const auto& [path, _] : subTreeObjects)
     {
-        InventoryItem item;
+        if (!isUnder(path, options.root))
+        {
+            continue;
+        }
+        InventoryItem& item = items.emplace_back();
         item.name = nameFromPath(path);
+        item.path = path;
+    }
 
-        for (const auto& [service, _] : objects)
+    if (options.verbose)
+    {
+        std::map<std::string, size_t> services;
+        for (const InventoryItem& item : items)
+        {
+            for (const auto& [service, _] : subTreeObjects[item.path])
+            {
+                ++services[service];
+            }
+        }
+        fprintf(stderr, "Object mapper found %zu inventory objects\n",
+                items.size());
+        for (const auto& [service, count] : services)
+        {
+            fprintf(stderr, "Query service %s for %zu objects\n",
+                    service.c_str(), count);
+        }
+    }
+
+    passOrdered(items, options.order, [&](InventoryItem& item) {
+        for (const auto& [service, _] : subTreeObjects[item.path])
         {
             // get all item's properties
             auto getProps = bus.new_method_call(
-                service.c_str(), path.c_str(),
+                service.c_str(), item.path.c_str(),
                 "org.freedesktop.DBus.Properties", "GetAll");
             getProps.append("");
             InventoryItem::Properties properties;
             bus.call(getProps).read(properties);
             item.merge(properties);
         }
-
-        items.emplace_back(item);
-    }
+        handler(item);
+    });
 #else
     using IfaceName = std::string;
     using Ifaces = std::map<IfaceName, InventoryItem::Properties>;
     using Objects = std::map<sdbusplus::message::object_path, Ifaces>;
 
-    static const std::vector<std::pair<std::string, std::string>>
-        inventoryServices{
-            {EM_SERVICE, EM_ROOT_PATH},
-            {SMBIOS_SERVICE, SMBIOS_ROOT_PATH},
-            {PCIE_SERVICE, PCIE_ROOT_PATH},
-            {STORAGE_SERVICE, STORAGE_ROOT_PATH},
-            {NET_ADAPTER_SERVICE, NET_ADAPTER_ROOT_PATH},
-        };
+    static const std::vector<InventoryService> inventoryServices{
+        {EM_SERVICE, EM_ROOT_PATH},
+        {SMBIOS_SERVICE, SMBIOS_ROOT_PATH},
+        {PCIE_SERVICE, PCIE_ROOT_PATH},
+        {STORAGE_SERVICE, STORAGE_ROOT_PATH},
+        {NET_ADAPTER_SERVICE, NET_ADAPTER_ROOT_PATH},
+    };
 
     static const std::unordered_set<IfaceName> wantedIfaces{
         "xyz.openbmc_project.Inventory.Decorator.Asset",
@@ -195,7 +351,18 @@ std::vector<InventoryItem> getInventory(sdbusplus::bus::bus& bus)
         "xyz.openbmc_project.State.Decorator.OperationalStatus",
     };
 
-    for (const auto& [service, rootpath] : inventoryServices)
+    // the final order is unknown until all services reply
+    std::vector<InventoryItem> items;
+    std::optional<ExternalSorter> sorter;
+    if (options.maxMemory && options.order == InventoryOptions::Order::name)
+    {
+        sorter.emplace(options.maxMemory);
+    }
+
+    // the set of services depends on the system configuration, query only
+    // existing ones to avoid activation attempts and timeouts
+    for (const auto& [service, rootpath] :
+         selectServices(inventoryServices, getBusNames(bus), options))
     {
         auto method = bus.new_method_call(service.c_str(), rootpath.c_str(),
                                           "org.freedesktop.DBus.ObjectManager",
@@ -205,6 +372,11 @@ std::vector<InventoryItem> getInventory(sdbusplus::bus::bus& bus)
 
         for (auto& [path, object] : objects)
         {
+            if (!isUnder(path.str, options.root))
+            {
+                continue;
+            }
+
             InventoryItem item;
 
             for (auto& [iface, props] : object)
@@ -218,14 +390,43 @@ std::vector<InventoryItem> getInventory(sdbusplus::bus::bus& bus)
             if (!item.properties.empty())
             {
                 item.name = nameFromPath(path.str);
-                items.emplace_back(item);
+                item.path = path.str;
+                if (options.order == InventoryOptions::Order::none)
+                {
+                    handler(item);
+                }
+                else if (sorter)
+                {
+                    sorter->add(std::move(item));
+                }
+                else
+                {
+                    items.emplace_back(std::move(item));
+                }
             }
         }
     }
-#endif
 
-    // sort in human readable order
-    std::sort(items.begin(), items.end(), humanCompare);
+    if (sorter)
+    {
+        if (options.verbose && sorter->runs())
+        {
+            fprintf(stderr, "Spilled %zu sorted runs\n", sorter->runs());
+        }
+        sorter->merge(handler);
+    }
+    else
+    {
+        passOrdered(items, options.order, handler);
+    }
+#endif
+}
 
+std::vector<InventoryItem> getInventory(sdbusplus::bus::bus& bus)
+{
+    std::vector<InventoryItem> items;
+    getInventory(bus, InventoryOptions(), [&items](InventoryItem& item) {
+        items.emplace_back(std::move(item));
+    });
     return items;
 }
@@ -5,8 +5,11 @@
 
 #include <sdbusplus/bus.hpp>
 
+#include <functional>
 #include <map>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -24,6 +27,9 @@ struct InventoryItem
     /** @brief Name of the item. */
     std::string name;
 
+    /** @brief D-Bus path of the item. */
+    std::string path;
+
     /** @brief Item's properties. */
     Properties properties;
 
@@ -49,6 +55,117 @@ struct InventoryItem
     void merge(Properties& props);
 };
 
+/**
+ * struct InventoryOptions
+ * @brief Options of inventory collection.
+ */
+struct InventoryOptions
+{
+    /** @brief Order of the collected items. */
+    enum class Order
+    {
+        /** @brief Order of arrival. */
+        none,
+        /** @brief Human readable order of item names. */
+        name,
+        /** @brief Depth-first order of D-Bus paths. */
+        path,
+    };
+
+    /** @brief Root path of the inventory subtree, empty for whole tree. */
+    std::string root;
+
+    /** @brief Order of items passed to the handler. */
+    Order order = Order::name;
+
+    /** @brief Report queried and skipped inventory sources to stderr. */
+    bool verbose = false;
+
+    /**
+     * @brief Memory budget in bytes for items collected to sort by name,
+     *        0 for unlimited. Items over the budget are spilled to disk.
+     */
+    size_t maxMemory = 0;
+};
+
+/**
+ * @brief Callback to handle collected inventory item.
+ *
+ * The handler is free to move the item's content out.
+ */
+using InventoryHandler = std::function<void(InventoryItem& item)>;
+
+/**
+ * @brief Comparator for human sorting of inventory item names.
+ *
+ * Comparsion based on digits inside the name:
+ * cpu1/core2 is less than cpu1/core10, but grater than cpu0/core10.
+ *
+ * @param[in] a first name to compare
+ * @param[in] b second name to compare
+ *
+ * @return comparsion result, true if a < b
+ */
+bool humanCompare(const std::string& a, const std::string& b);
+
+/**
+ * @brief Normalize root path of the inventory subtree.
+ *
+ * Trailing slashes are ignored, so "/" is the whole tree.
+ *
+ * @param[in] path D-Bus path of the subtree's root
+ *
+ * @return path without trailing slashes, empty for the whole tree
+ */
+std::string subtreeRoot(const std::string& path);
+
+/** @brief Inventory service: bus name and root path of its objects. */
+using InventoryService = std::pair<std::string, std::string>;
+
+/**
+ * @brief Select inventory services to query for the subtree.
+ *
+ * Services absent on the bus are skipped to avoid activation attempts and
+ * timeouts, as well as services with objects outside the subtree.
+ *
+ * @param[in] services known inventory services
+ * @param[in] busNames names of running and activatable services
+ * @param[in] options collection options
+ *
+ * @return services to query
+ */
+std::vector<InventoryService>
+    selectServices(const std::vector<InventoryService>& services,
+                   const std::unordered_set<std::string>& busNames,
+                   const InventoryOptions& options);
+
+/**
+ * @brief Sort inventory items.
+ *
+ * Items with the same path are merged in the depth-first order.
+ *
+ * @param[in,out] items array of items to sort
+ * @param[in] order requested order
+ */
+void sortInventory(std::vector<InventoryItem>& items,
+                   InventoryOptions::Order order);
+
+/**
+ * @brief Get inventory items, passing each of them to the handler as soon
+ *        as its properties are read.
+ *
+ * With the object mapper the order is known before reading properties, so
+ * the items are passed one by one in any order. Otherwise all the items are
+ * collected first unless the order of arrival is requested, memory used by
+ * collected items is limited by maxMemory when sorting by name.
+ *
+ * @param[in] bus D-Bus instance to read inventory
+ * @param[in] options collection options
+ * @param[in] handler callback for inventory items
+ */
+void getInventory(sdbusplus::bus::bus& bus, const InventoryOptions& options,
+                  const InventoryHandler& handler);
+
 /**
  * @brief Get all inventory items.
  *
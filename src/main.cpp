@@ -2,10 +2,23 @@
 // Copyright (C) 2020 YADRO
 
 #include "config.hpp"
+#include "fru.hpp"
+#include "history.hpp"
 #include "printer.hpp"
+#include "tree.hpp"
 #include "version.hpp"
 
 #include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
 
 /**
  * @brief Print help usage info.
@@ -18,105 +31,754 @@ static void printHelp(const char* app)
     printf("Copyright (c) 2020 YADRO.\n");
     printf("Version " VERSION "\n");
     printf("Usage: %s [OPTION...]\n", app);
-    printf("  -n, --name=NAME  Print item with specified name only\n");
+    printf("       %s --batch=FILE\n", app);
+    printf("  -n, --name=NAME  Print item with specified name or path only\n");
     printf("  -a, --all        Also print non-present units\n");
     printf("  -e, --empty      Also print empty properties\n");
-    printf("  -j, --json       Print in JSON format\n");
+    printf("  -f, --format=FMT Output format: text/tree/json/ndjson/csv\n");
+    printf("  -j, --json       Print in JSON format, same as --format=json\n");
+    printf("  -t, --tree       Print D-Bus hierarchy, same as --format=tree\n");
+    printf("  -u, --unsorted   Print items in order of arrival\n");
+    printf("  -U, --under=PATH Print subtree of specified D-Bus path only\n");
+    printf("  -v, --verbose    Report queried and skipped inventory sources\n");
+    printf("  -m, --max-memory=SIZE\n");
+    printf("                   Limit memory used to sort items, spill the\n");
+    printf("                   rest to temporary files, SIZE may have K/M/G\n");
+    printf("                   suffix, not supported with JSON output\n");
+    printf("  -J, --jobs=NUM   Format large output with up to NUM threads,\n");
+    printf("                   default is the number of CPUs for JSON and\n");
+    printf("                   multiple queries\n");
+    printf("  -E, --eeprom[=DIR]\n");
+    printf("                   Also read FRU EEPROMs from DIR/*/eeprom,\n");
+    printf("                   default is " FRU_PATH "\n");
+    printf("  -b, --batch=FILE Run queries from FILE, one per line,\n");
+    printf("                   \"-\" reads queries from stdin\n");
+    printf("  -r, --record     Record inventory changes to the history file\n");
+    printf("  -T, --at=TIME    Print inventory recorded at specified time,\n");
+    printf("                   TIME is Unix time or YYYY-MM-DD[ HH:MM[:SS]]\n");
+    printf("  -F, --history=FILE\n");
+    printf("                   History file, default is " HISTORY_FILE "\n");
     printf("  -h, --help       Print this help and exit\n");
 #ifdef REMOTE_HOST_SUPPORT
     printf("  -H, --host       Get data from remote host over SSH\n");
 #endif
 }
 
-/** @brief Application entry point. */
-int main(int argc, char* argv[])
+/**
+ * @brief Get output format by its name.
+ *
+ * @param[in] name format name
+ * @param[out] format output format
+ *
+ * @return false if format name is unknown
+ */
+static bool formatFromName(const char* name, Printer::Format& format)
+{
+    // clang-format off
+    static const std::pair<const char*, Printer::Format> formats[] = {
+        {"text",   Printer::Format::text  },
+        {"tree",   Printer::Format::tree  },
+        {"json",   Printer::Format::json  },
+        {"ndjson", Printer::Format::ndjson},
+        {"csv",    Printer::Format::csv   },
+    };
+    // clang-format on
+
+    for (const auto& [fmtName, fmt] : formats)
+    {
+        if (strcmp(name, fmtName) == 0)
+        {
+            format = fmt;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Parse size with optional K/M/G suffix.
+ *
+ * @param[in] str size to parse
+ * @param[out] size size in bytes
+ *
+ * @return false if the size is invalid
+ */
+static bool parseSize(const char* str, size_t& size)
+{
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long long num = strtoull(str, &end, 10);
+    if (errno || end == str || !isdigit(*str))
+    {
+        return false;
+    }
+    unsigned shift = 0;
+    switch (*end)
+    {
+        case 'K':
+        case 'k':
+            shift = 10;
+            break;
+        case 'M':
+        case 'm':
+            shift = 20;
+            break;
+        case 'G':
+        case 'g':
+            shift = 30;
+            break;
+        case '\0':
+            break;
+        default:
+            return false;
+    }
+    if (shift && *++end)
+    {
+        return false;
+    }
+    size = num << shift;
+    return size && (size >> shift) == num;
+}
+
+/**
+ * struct Query
+ * @brief Inventory query: collection options, filters and output format.
+ */
+struct Query
 {
+    /** @brief Query text (batch mode). */
+    std::string text;
+    /** @brief Collection options. */
+    InventoryOptions options;
+    /** @brief Printer with filters and format. */
     Printer printer;
-    bool printJson = false;
-#ifdef REMOTE_HOST_SUPPORT
+};
+
+/**
+ * struct Params
+ * @brief Application wide parameters.
+ */
+struct Params
+{
+    /** @brief Batch file name. */
+    const char* batch = nullptr;
+    /** @brief Remote host name. */
     const char* host = nullptr;
-#endif
+    /** @brief Directory with FRU EEPROMs, nullptr to skip them. */
+    const char* fru = nullptr;
+    /** @brief History file name. */
+    const char* history = HISTORY_FILE;
+    /** @brief Record inventory to history. */
+    bool record = false;
+    /** @brief Time of the inventory to read from history. */
+    const char* at = nullptr;
+    /** @brief Max number of formatting threads, 0 for all CPUs. */
+    size_t jobs = 0;
+    /** @brief Help requested. */
+    bool help = false;
+};
+
+/**
+ * @brief Parse command line arguments.
+ *
+ * @param[in] argc number of arguments
+ * @param[in] argv array of arguments
+ * @param[out] query query to fill
+ * @param[out] params application parameters, nullptr for batch queries
+ *
+ * @return false if arguments are invalid
+ */
+static bool parseArgs(int argc, char* argv[], Query& query, Params* params)
+{
+    Printer::Format format = Printer::Format::text;
 
     // clang-format off
     const struct option longOpts[] = {
-        {"name",  required_argument, nullptr, 'n'},
-        {"all",   no_argument,       nullptr, 'a'},
-        {"empty", no_argument,       nullptr, 'e'},
-        {"json",  no_argument,       nullptr, 'j'},
-        {"help",  no_argument,       nullptr, 'h'},
+        {"name",     required_argument, nullptr, 'n'},
+        {"all",      no_argument,       nullptr, 'a'},
+        {"empty",    no_argument,       nullptr, 'e'},
+        {"format",   required_argument, nullptr, 'f'},
+        {"json",     no_argument,       nullptr, 'j'},
+        {"tree",     no_argument,       nullptr, 't'},
+        {"unsorted", no_argument,       nullptr, 'u'},
+        {"under",    required_argument, nullptr, 'U'},
+        {"verbose",  no_argument,       nullptr, 'v'},
+        {"max-memory", required_argument, nullptr, 'm'},
+        {"jobs",     required_argument, nullptr, 'J'},
+        {"eeprom",   optional_argument, nullptr, 'E'},
+        {"batch",    required_argument, nullptr, 'b'},
+        {"record",   no_argument,       nullptr, 'r'},
+        {"at",       required_argument, nullptr, 'T'},
+        {"history",  required_argument, nullptr, 'F'},
+        {"help",     no_argument,       nullptr, 'h'},
 #ifdef REMOTE_HOST_SUPPORT
-        {"host",  required_argument, nullptr, 'H'},
+        {"host",     required_argument, nullptr, 'H'},
 #endif
-        {nullptr, 0,                 nullptr,  0 }
+        {nullptr,    0,                 nullptr,  0 }
     };
 #ifdef REMOTE_HOST_SUPPORT
-    const char* shortOpts = "n:aejhH:";
+    const char* shortOpts = "n:aef:jtuU:vm:J:E::b:rT:F:hH:";
 #else
-    const char* shortOpts = "n:aejh";
+    const char* shortOpts = "n:aef:jtuU:vm:J:E::b:rT:F:h";
 #endif
     // clang-format on
 
     opterr = 0; // prevent native error messages
+    optind = 0; // reinitialize parser for the next batch query
 
     // parse arguments
     int val;
+    bool hasQueryOpts = false;
     while ((val = getopt_long(argc, argv, shortOpts, longOpts, nullptr)) != -1)
     {
+        if (val > 0 && strchr("naefjtuUm", val))
+        {
+            hasQueryOpts = true;
+        }
         switch (val)
         {
             case 'n':
-                printer.setNameFilter(optarg);
+                query.printer.setNameFilter(optarg);
                 break;
             case 'a':
-                printer.allowNonPresent();
+                query.printer.allowNonPresent();
                 break;
             case 'e':
-                printer.allowEmptyProperties();
+                query.printer.allowEmptyProperties();
+                break;
+            case 'f':
+                if (!formatFromName(optarg, format))
+                {
+                    fprintf(stderr, "Invalid format: %s\n", optarg);
+                    return false;
+                }
                 break;
             case 'j':
-                printJson = true;
+                format = Printer::Format::json;
+                break;
+            case 't':
+                format = Printer::Format::tree;
+                break;
+            case 'u':
+                query.options.order = InventoryOptions::Order::none;
+                break;
+            case 'U':
+                query.options.root = subtreeRoot(optarg);
+                break;
+            case 'v':
+                query.options.verbose = true;
+                break;
+            case 'm':
+                if (!params)
+                {
+                    fprintf(stderr, "Memory limit is not allowed in batch "
+                                    "query\n");
+                    return false;
+                }
+                if (!parseSize(optarg, query.options.maxMemory))
+                {
+                    fprintf(stderr, "Invalid size: %s\n", optarg);
+                    return false;
+                }
+                break;
+            case 'J':
+            {
+                if (!params)
+                {
+                    fprintf(stderr, "Jobs are not allowed in batch query\n");
+                    return false;
+                }
+                char* end = nullptr;
+                params->jobs = strtoul(optarg, &end, 10);
+                if (!isdigit(*optarg) || *end)
+                {
+                    fprintf(stderr, "Invalid number of jobs: %s\n", optarg);
+                    return false;
+                }
+                break;
+            }
+            case 'b':
+                if (!params)
+                {
+                    fprintf(stderr, "Nested batch is not allowed\n");
+                    return false;
+                }
+                params->batch = optarg;
+                break;
+            case 'E':
+                if (!params)
+                {
+                    fprintf(stderr, "EEPROM is not allowed in batch query\n");
+                    return false;
+                }
+                params->fru = optarg ? optarg : FRU_PATH;
+                break;
+            case 'r':
+            case 'T':
+            case 'F':
+                if (!params)
+                {
+                    fprintf(stderr, "History is not allowed in batch query\n");
+                    return false;
+                }
+                if (val == 'r')
+                {
+                    params->record = true;
+                }
+                else if (val == 'T')
+                {
+                    params->at = optarg;
+                }
+                else
+                {
+                    params->history = optarg;
+                }
                 break;
 #ifdef REMOTE_HOST_SUPPORT
             case 'H':
-                host = optarg;
+                if (!params)
+                {
+                    fprintf(stderr, "Host is not allowed in batch query\n");
+                    return false;
+                }
+                params->host = optarg;
                 break;
 #endif
             case 'h':
-                printHelp(argv[0]);
-                return EXIT_SUCCESS;
+                if (!params)
+                {
+                    fprintf(stderr, "Help is not allowed in batch query\n");
+                    return false;
+                }
+                params->help = true;
+                return true;
             default:
                 fprintf(stderr, "Invalid option: %s\n", argv[optind - 1]);
-                return EXIT_FAILURE;
+                return false;
         }
     }
     if (optind < argc)
     {
         fprintf(stderr, "Unexpected option: %s\n", argv[optind]);
+        return false;
+    }
+    if (params && params->record && params->at)
+    {
+        fprintf(stderr, "Options --record and --at are mutually exclusive\n");
+        return false;
+    }
+    if (params && params->batch && hasQueryOpts)
+    {
+        // each batch line has its own query options
+        fprintf(stderr, "Query options are not allowed with --batch\n");
+        return false;
+    }
+    if (params && query.options.maxMemory &&
+        (params->batch || params->record || params->at || params->fru))
+    {
+        // all the items are kept in memory for several consumers
+        fprintf(stderr, "Option --max-memory is for a single query only\n");
+        return false;
+    }
+    if (query.options.maxMemory && format == Printer::Format::json)
+    {
+        // JSON document is built in memory as a whole
+        fprintf(stderr, "Option --max-memory is not supported with JSON "
+                        "output\n");
+        return false;
+    }
+
+    query.printer.setFormat(format);
+    query.printer.setRoot(query.options.root);
+    if (format == Printer::Format::tree)
+    {
+        // hierarchy can be printed in depth-first order only
+        query.options.order = InventoryOptions::Order::path;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Read batch queries.
+ *
+ * Each line of the file contains options of a single query, empty lines and
+ * lines started with '#' are ignored.
+ *
+ * @param[in] file batch file name, "-" for stdin
+ * @param[out] queries array of queries
+ *
+ * @return false if file can not be read or contains invalid query
+ */
+static bool readBatch(const char* file, std::vector<Query>& queries)
+{
+    std::ifstream fileStream;
+    if (strcmp(file, "-") != 0)
+    {
+        fileStream.open(file);
+        if (!fileStream)
+        {
+            fprintf(stderr, "Unable to open batch file %s\n", file);
+            return false;
+        }
+    }
+    std::istream& input = fileStream.is_open() ? fileStream : std::cin;
+
+    std::string line;
+    size_t lineNum = 0;
+    while (std::getline(input, line))
+    {
+        ++lineNum;
+
+        std::istringstream tokenizer(line);
+        std::vector<std::string> args;
+        std::string token;
+        while (tokenizer >> token)
+        {
+            args.emplace_back(std::move(token));
+        }
+        if (args.empty() || args.front().front() == '#')
+        {
+            continue;
+        }
+
+        std::vector<char*> argv;
+        static char app[] = "lsinventory";
+        argv.push_back(app);
+        for (std::string& arg : args)
+        {
+            argv.push_back(arg.data());
+        }
+        argv.push_back(nullptr);
+
+        Query& query = queries.emplace_back();
+        query.text = line;
+        if (!parseArgs(static_cast<int>(args.size() + 1), argv.data(), query,
+                       nullptr))
+        {
+            fprintf(stderr, "Invalid batch query at line %zu: %s\n", lineNum,
+                    line.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Get common root of two D-Bus paths.
+ *
+ * @param[in] a first path
+ * @param[in] b second path
+ *
+ * @return common root, empty if there is no common parent except "/"
+ */
+static std::string commonRoot(const std::string& a, const std::string& b)
+{
+    size_t end = 0;
+    for (size_t i = 0; i <= a.length() && i <= b.length(); ++i)
+    {
+        const bool endA = i == a.length() || a[i] == '/';
+        const bool endB = i == b.length() || b[i] == '/';
+        if (endA && endB)
+        {
+            end = i;
+        }
+        if (i == a.length() || i == b.length() || a[i] != b[i])
+        {
+            break;
+        }
+    }
+    return a.substr(0, end);
+}
+
+/**
+ * @brief Parse time specification.
+ *
+ * @param[in] str Unix time or local time in YYYY-MM-DD[ HH:MM[:SS]] format
+ * @param[out] timestamp parsed time
+ *
+ * @return false if time specification is invalid
+ */
+static bool parseTime(const char* str, time_t& timestamp)
+{
+    char* end = nullptr;
+    const long long unixTime = strtoll(str, &end, 10);
+    if (*str && !*end)
+    {
+        timestamp = static_cast<time_t>(unixTime);
+        return true;
+    }
+
+    static const char* formats[] = {
+        "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M",
+        "%Y-%m-%dT%H:%M",    "%Y-%m-%d",
+    };
+    for (const char* format : formats)
+    {
+        struct tm tm = {};
+        const char* parsed = strptime(str, format, &tm);
+        if (parsed && !*parsed)
+        {
+            tm.tm_isdst = -1;
+            timestamp = mktime(&tm);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Print collected inventory for each query.
+ *
+ * @param[in] items inventory items in human readable order
+ * @param[in] queries array of queries
+ * @param[in] delimit flag to delimit results of the queries
+ */
+static void printQueries(const std::vector<InventoryItem>& items,
+                         const std::vector<Query>& queries, bool delimit)
+{
+    // depth-first order is built on demand
+    std::vector<InventoryItem> byPath;
+    bool hasPathOrder = false;
+
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        const Query& query = queries[i];
+
+        const std::vector<InventoryItem>* ordered = &items;
+        if (query.options.order == InventoryOptions::Order::path)
+        {
+            if (!hasPathOrder)
+            {
+                byPath = items;
+                sortInventory(byPath, InventoryOptions::Order::path);
+                hasPathOrder = true;
+            }
+            ordered = &byPath;
+        }
+
+        if (delimit)
+        {
+            printf("%s==> %s <==\n", i ? "\n" : "", query.text.c_str());
+        }
+        query.printer.print(*ordered);
+    }
+}
+
+/**
+ * @brief Open D-Bus connection.
+ *
+ * @param[in] params application parameters
+ *
+ * @return D-Bus instance
+ */
+static sdbusplus::bus::bus openBus(const Params& params)
+{
+    sdbusplus::bus::bus bus = sdbusplus::bus::new_default();
+#ifdef REMOTE_HOST_SUPPORT
+    if (params.host)
+    {
+        sd_bus* b = nullptr;
+        sd_bus_open_system_remote(&b, params.host);
+        bus = sdbusplus::bus::bus(b, std::false_type());
+    }
+#else
+    (void)params;
+#endif
+    return bus;
+}
+
+/**
+ * @brief Collect inventory items from D-Bus and FRU EEPROMs.
+ *
+ * @param[in] params application parameters
+ * @param[in] queries array of queries
+ * @param[out] complete false if D-Bus inventory is unavailable
+ *
+ * @return inventory items in human readable order
+ */
+static std::vector<InventoryItem>
+    collectInventory(const Params& params, const std::vector<Query>& queries,
+                     bool& complete)
+{
+    // collect the smallest subtree that covers all the queries,
+    // history is recorded for the whole inventory
+    InventoryOptions options;
+    options.root = queries.front().options.root;
+    for (const Query& query : queries)
+    {
+        options.root = commonRoot(options.root, query.options.root);
+        options.verbose |= query.options.verbose;
+    }
+    if (params.record)
+    {
+        options.root.clear();
+    }
+
+    // EEPROMs are read while D-Bus services are queried
+    std::future<std::vector<InventoryItem>> fruItems;
+    if (params.fru)
+    {
+        fruItems = std::async(std::launch::async, getFruInventory,
+                              std::string(params.fru));
+    }
+
+    std::vector<InventoryItem> items;
+    complete = true;
+    try
+    {
+        sdbusplus::bus::bus bus = openBus(params);
+        getInventory(bus, options, [&items](InventoryItem& item) {
+            items.emplace_back(std::move(item));
+        });
+    }
+    catch (const std::exception& ex)
+    {
+        if (!params.fru)
+        {
+            throw;
+        }
+        // EEPROMs are readable while inventory services are not ready
+        fprintf(stderr, "D-Bus inventory is unavailable: %s\n", ex.what());
+        items.clear();
+        complete = false;
+    }
+
+    if (params.fru)
+    {
+        mergeFruInventory(items, fruItems.get());
+        sortInventory(items, InventoryOptions::Order::name);
+    }
+
+    return items;
+}
+
+/**
+ * @brief Choose delivery of items to the output for single query.
+ *
+ * @param[in] query inventory query
+ * @param[in] jobs number of formatting threads, 0 for default
+ *
+ * @return delivery mode
+ */
+static Printer::Delivery delivery(const Query& query, size_t jobs)
+{
+    const bool interactive = isatty(STDOUT_FILENO);
+    if (query.options.order == InventoryOptions::Order::none)
+    {
+        // order of arrival is for watching the progress
+        return Printer::Delivery::flush;
+    }
+    if (query.options.maxMemory)
+    {
+        // collected items would exceed the budget
+        return interactive ? Printer::Delivery::flush
+                           : Printer::Delivery::stream;
+    }
+    if (query.printer.getFormat() == Printer::Format::json)
+    {
+        // the document is built in memory anyway, so format it in parallel
+        return Printer::Delivery::collect;
+    }
+    if (!interactive)
+    {
+        // pipes get items as they arrive unless threads are requested
+        return jobs > 1 ? Printer::Delivery::collect
+                        : Printer::Delivery::stream;
+    }
+    return Printer::Delivery::flush;
+}
+
+/** @brief Application entry point. */
+int main(int argc, char* argv[])
+{
+    Params params;
+    std::vector<Query> queries(1);
+
+    if (!parseArgs(argc, argv, queries.front(), &params))
+    {
+        return EXIT_FAILURE;
+    }
+    if (params.help)
+    {
+        printHelp(argv[0]);
+        return EXIT_SUCCESS;
+    }
+    time_t at = 0;
+    if (params.at && !parseTime(params.at, at))
+    {
+        fprintf(stderr, "Invalid time: %s\n", params.at);
         return EXIT_FAILURE;
     }
+    if (params.batch)
+    {
+        // verbose flag is run-wide
+        const bool verbose = queries.front().options.verbose;
+        queries.clear();
+        if (!readBatch(params.batch, queries))
+        {
+            return EXIT_FAILURE;
+        }
+        if (queries.empty())
+        {
+            return EXIT_SUCCESS;
+        }
+        queries.front().options.verbose |= verbose;
+    }
+
+    for (Query& query : queries)
+    {
+        query.printer.setJobs(params.jobs);
+    }
 
     // print inventory list
     try
     {
-        sdbusplus::bus::bus bus = sdbusplus::bus::new_default();
-#ifdef REMOTE_HOST_SUPPORT
-        if (host)
+        if (params.at)
         {
-            sd_bus* b = nullptr;
-            sd_bus_open_system_remote(&b, host);
-            bus = sdbusplus::bus::bus(b, std::false_type());
+            std::vector<InventoryItem> items = History(params.history).at(at);
+            sortInventory(items, InventoryOptions::Order::name);
+            printQueries(items, queries, params.batch != nullptr);
+            return EXIT_SUCCESS;
         }
-#endif
 
-        const std::vector<InventoryItem> items = getInventory(bus);
-        if (printJson)
+        if (!params.batch && !params.record && !params.fru)
+        {
+            sdbusplus::bus::bus bus = openBus(params);
+            const Query& query = queries.front();
+            query.printer.print(
+                [&bus, &query](const InventoryHandler& handler) {
+                    getInventory(bus, query.options, handler);
+                },
+                delivery(query, params.jobs));
+            return EXIT_SUCCESS;
+        }
+
+        bool complete;
+        const std::vector<InventoryItem> items =
+            collectInventory(params, queries, complete);
+
+        if (params.record && !complete)
         {
-            printer.printJson(items);
+            // partial state would be recorded as removal of D-Bus items
+            fprintf(stderr, "History is not recorded: inventory is "
+                            "incomplete\n");
+            printQueries(items, queries, params.batch != nullptr);
+            return EXIT_FAILURE;
         }
-        else
+        if (params.record)
         {
-            printer.printText(items);
+            const size_t changes =
+                History(params.history).record(items, time(nullptr));
+            if (queries.front().options.verbose)
+            {
+                fprintf(stderr, "Recorded %zu changed items\n", changes);
+            }
         }
+
+        printQueries(items, queries, params.batch != nullptr);
     }
     catch (std::exception& ex)
     {
@@ -3,114 +3,817 @@
 
 #include "printer.hpp"
 
+#include "config.hpp"
+
 #include <nlohmann/json.hpp>
 
-void Printer::setNameFilter(const char* name)
+#include <algorithm>
+#include <future>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+namespace
 {
-    nameFilter = name;
-}
 
-void Printer::allowNonPresent()
+using PropName = InventoryItem::PropName;
+using PropValue = InventoryItem::PropValue;
+
+/**
+ * @brief Get text representation of the property value.
+ *
+ * @param[in] value property value
+ *
+ * @return value as text
+ */
+std::string toText(const PropValue& value)
 {
-    printNonPresent = true;
+    std::string val;
+    std::visit(
+        [&val](auto&& arg) {
+            using T = std::decay_t<decltype(arg)>;
+            if constexpr (std::is_same_v<T, bool>)
+                val = arg ? "Yes" : "No";
+            else if constexpr (std::is_arithmetic<T>::value)
+                val = std::to_string(arg);
+            else if constexpr (std::is_same_v<T, std::string>)
+                val = arg;
+            else
+                static_assert(T::value, "Unhandled value type");
+        },
+        value);
+    return val;
 }
 
-void Printer::allowEmptyProperties()
+/**
+ * @brief Get JSON representation of the property value.
+ *
+ * @param[in] value property value
+ *
+ * @return value as JSON node
+ */
+nlohmann::json toJson(const PropValue& value)
 {
-    printEmptyProperties = true;
+    return std::visit([](auto&& arg) { return nlohmann::json(arg); }, value);
 }
 
-void Printer::printText(const std::vector<InventoryItem>& items) const
+/**
+ * @brief Append property line of the text output.
+ *
+ * @param[out] out output buffer
+ * @param[in] indent indentation of the line
+ * @param[in] name property name
+ * @param[in] value property value
+ */
+void appendProperty(std::string& out, size_t indent, const PropName& name,
+                    const PropValue& value)
 {
     // Size of the column with property name (formatting output)
-    static const int PropNmColWidth = 20;
+    static constexpr size_t PropNmColWidth = 20;
+
+    out.append(indent, ' ');
+    out += name;
+    out += ": ";
+    if (name.length() < PropNmColWidth)
+    {
+        out.append(PropNmColWidth - name.length(), ' ');
+    }
+    out += toText(value);
+    out += '\n';
+}
+
+/**
+ * @struct NameFilter
+ * @brief Item filter stage: pass items with specified name only.
+ */
+struct NameFilter
+{
+    const std::string& name;
+
+    bool operator()(const InventoryItem& item) const
+    {
+        return item.name == name;
+    }
+};
+
+/**
+ * @struct PathFilter
+ * @brief Item filter stage: pass items with specified D-Bus path only.
+ */
+struct PathFilter
+{
+    const std::string& path;
+
+    bool operator()(const InventoryItem& item) const
+    {
+        return item.path == path;
+    }
+};
+
+/**
+ * @struct SubtreeFilter
+ * @brief Item filter stage: pass items from specified D-Bus subtree only.
+ */
+struct SubtreeFilter
+{
+    const std::string& root;
+
+    bool operator()(const InventoryItem& item) const
+    {
+        return item.path.compare(0, root.length(), root) == 0 &&
+               (item.path.length() == root.length() ||
+                item.path[root.length()] == '/');
+    }
+};
+
+/**
+ * @struct PresentFilter
+ * @brief Item filter stage: pass present items only.
+ */
+struct PresentFilter
+{
+    bool operator()(const InventoryItem& item) const
+    {
+        return item.isPresent();
+    }
+};
+
+/**
+ * @struct NonEmptyFilter
+ * @brief Property filter stage: pass non-empty values only.
+ */
+struct NonEmptyFilter
+{
+    bool operator()(const PropValue& value) const
+    {
+        const std::string* str = std::get_if<std::string>(&value);
+        return !str || !str->empty();
+    }
+};
+
+/**
+ * @struct Chain
+ * @brief Compile-time chain of filter stages, empty chain passes everything.
+ */
+template <class... Stages>
+struct Chain
+{
+    std::tuple<Stages...> stages;
+
+    template <class T>
+    bool operator()(const T& arg) const
+    {
+        return std::apply(
+            [&](const Stages&... stage) { return (true && ... && stage(arg)); },
+            stages);
+    }
+
+    template <class Stage>
+    Chain<Stages..., Stage> then(Stage stage) const
+    {
+        return {std::tuple_cat(stages, std::make_tuple(stage))};
+    }
+};
+
+/**
+ * @struct TextFormatter
+ * @brief Formatter stage: human readable text.
+ */
+struct TextFormatter
+{
+    static constexpr bool parallel = true;
+
+    void begin(std::string&)
+    {}
+
+    void beginItem(std::string& out, const InventoryItem& item)
+    {
+        out += item.name;
+        out += ": ";
+        out += item.prettyName();
+        out += '\n';
+    }
+
+    void property(std::string& out, const PropName& name,
+                  const PropValue& value)
+    {
+        appendProperty(out, 2, name, value);
+    }
+
+    void endItem(std::string&, const InventoryItem&)
+    {}
+
+    void end(std::string&)
+    {}
+
+    void merge(TextFormatter&&)
+    {}
+};
+
+/**
+ * @struct TreeFormatter
+ * @brief Formatter stage: text with D-Bus hierarchy, expects items in
+ *        depth-first order.
+ */
+struct TreeFormatter
+{
+    // output of the item depends on the previous one
+    static constexpr bool parallel = false;
+
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] root root path, the tree starts from its last component
+     */
+    explicit TreeFormatter(const std::string& root) :
+        root(root.empty() ? INVENTORY_PATH : root)
+    {}
 
-    for (const InventoryItem& item : items)
+    void begin(std::string&)
+    {}
+
+    void beginItem(std::string& out, const InventoryItem& item)
     {
-        if (!checkFilter(item))
+        // path relative to the root's parent
+        size_t start = 0;
+        const size_t parent = root.rfind('/');
+        if (parent != std::string::npos &&
+            item.path.compare(0, parent + 1, root, 0, parent + 1) == 0)
         {
-            continue;
+            start = parent + 1;
+        }
+        std::vector<std::string> nodes;
+        while (start < item.path.length())
+        {
+            size_t end = item.path.find('/', start);
+            if (end == std::string::npos)
+            {
+                end = item.path.length();
+            }
+            if (end != start)
+            {
+                nodes.emplace_back(item.path.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+        if (nodes.empty())
+        {
+            nodes.emplace_back(item.name);
         }
 
-        // print title
-        printf("%s: %s\n", item.name.c_str(), item.prettyName().c_str());
-
-        // print properties
-        for (const auto& property : item.properties)
+        // print nodes that are not shared with the previous item
+        size_t common = 0;
+        while (common < nodes.size() - 1 && common < last.size() &&
+               nodes[common] == last[common])
         {
-            // get value from variant
-            std::string val;
-            std::visit(
-                [&val](auto&& arg) {
-                    using T = std::decay_t<decltype(arg)>;
-                    if constexpr (std::is_same_v<T, bool>)
-                        val = arg ? "Yes" : "No";
-                    else if constexpr (std::is_arithmetic<T>::value)
-                        val = std::to_string(arg);
-                    else if constexpr (std::is_same_v<T, std::string>)
-                        val = arg;
-                    else
-                        static_assert(T::value, "Unhandled value type");
-                },
-                property.second);
+            ++common;
+        }
+        for (size_t i = common; i < nodes.size() - 1; ++i)
+        {
+            out.append(i * 2, ' ');
+            out += nodes[i];
+            out += '\n';
+        }
+
+        depth = nodes.size() - 1;
+        out.append(depth * 2, ' ');
+        out += nodes.back();
+        out += ": ";
+        out += item.prettyName();
+        out += '\n';
+
+        last = std::move(nodes);
+    }
+
+    void property(std::string& out, const PropName& name,
+                  const PropValue& value)
+    {
+        appendProperty(out, depth * 2 + 2, name, value);
+    }
+
+    void endItem(std::string&, const InventoryItem&)
+    {}
+
+    void end(std::string&)
+    {}
+
+    /** @brief Root path. */
+    const std::string root;
+    /** @brief Path nodes of the last printed item. */
+    std::vector<std::string> last;
+    /** @brief Depth of the current item. */
+    size_t depth = 0;
+};
+
+/**
+ * @struct JsonFormatter
+ * @brief Formatter stage: single JSON document with items as keys.
+ *
+ * Items are dumped as soon as they are complete, so the most of work is
+ * done in parallel chunks. The document is the same as dumped by nlohmann:
+ * keys are sorted and the first of duplicate keys wins.
+ */
+struct JsonFormatter
+{
+    static constexpr bool parallel = true;
+    static constexpr auto JsonPrettyLookOffset = 2;
+
+    void begin(std::string&)
+    {}
+
+    void beginItem(std::string&, const InventoryItem&)
+    {
+        jsonItem = nlohmann::json::object();
+    }
+
+    void property(std::string&, const PropName& name, const PropValue& value)
+    {
+        jsonItem.emplace(name, toJson(value));
+    }
 
-            // filter out empty properties
-            if (!val.empty() || printEmptyProperties)
+    void endItem(std::string&, const InventoryItem& item)
+    {
+        if (jsonItem.empty() || items.find(item.name) != items.end())
+        {
+            return;
+        }
+        // indent the item as nested into the document
+        const std::string dump = jsonItem.dump(JsonPrettyLookOffset);
+        std::string nested;
+        nested.reserve(dump.size() + dump.size() / 8);
+        for (const char ch : dump)
+        {
+            nested += ch;
+            if (ch == '\n')
             {
-                const int nameLen = static_cast<int>(property.first.length());
-                printf("  %s: %*s%s\n", property.first.c_str(),
-                       nameLen < PropNmColWidth ? PropNmColWidth - nameLen : 0,
-                       "", val.c_str());
+                nested.append(JsonPrettyLookOffset, ' ');
             }
         }
+        items.emplace(item.name, std::move(nested));
+    }
+
+    void end(std::string& out)
+    {
+        if (items.empty())
+        {
+            out += "{}\n";
+            return;
+        }
+        const char* separator = "{\n";
+        for (const auto& [name, dump] : items)
+        {
+            out += separator;
+            separator = ",\n";
+            out.append(JsonPrettyLookOffset, ' ');
+            out += nlohmann::json(name).dump();
+            out += ": ";
+            out += dump;
+        }
+        out += "\n}\n";
+    }
+
+    void merge(JsonFormatter&& chunk)
+    {
+        // existing keys are kept, as they came from the previous chunks
+        items.merge(chunk.items);
+    }
+
+    /** @brief Dumped items by their names. */
+    std::map<std::string, std::string> items;
+    nlohmann::json jsonItem;
+};
+
+/**
+ * @struct NdJsonFormatter
+ * @brief Formatter stage: newline delimited JSON, one item per line.
+ */
+struct NdJsonFormatter
+{
+    static constexpr bool parallel = true;
+
+    void begin(std::string&)
+    {}
+
+    void beginItem(std::string&, const InventoryItem&)
+    {
+        jsonProps = nlohmann::json::object();
+    }
+
+    void property(std::string&, const PropName& name, const PropValue& value)
+    {
+        jsonProps.emplace(name, toJson(value));
+    }
+
+    void endItem(std::string& out, const InventoryItem& item)
+    {
+        nlohmann::json jsonItem = {{"name", item.name},
+                                   {"properties", std::move(jsonProps)}};
+        out += jsonItem.dump();
+        out += '\n';
     }
-}
 
-void Printer::printJson(const std::vector<InventoryItem>& items) const
+    void end(std::string&)
+    {}
+
+    void merge(NdJsonFormatter&&)
+    {}
+
+    nlohmann::json jsonProps;
+};
+
+/**
+ * @struct CsvFormatter
+ * @brief Formatter stage: CSV (RFC 4180), one property per row.
+ */
+struct CsvFormatter
 {
-    nlohmann::json json = nlohmann::json::object();
+    static constexpr bool parallel = true;
+
+    void begin(std::string& out)
+    {
+        out += "Item,Property,Value\n";
+    }
+
+    void beginItem(std::string&, const InventoryItem& item)
+    {
+        itemName = &item.name;
+    }
+
+    void property(std::string& out, const PropName& name,
+                  const PropValue& value)
+    {
+        field(out, *itemName);
+        out += ',';
+        field(out, name);
+        out += ',';
+        field(out, toText(value));
+        out += '\n';
+    }
+
+    void endItem(std::string&, const InventoryItem&)
+    {}
+
+    void end(std::string&)
+    {}
+
+    void merge(CsvFormatter&&)
+    {}
 
-    for (const InventoryItem& item : items)
+    /**
+     * @brief Append field, quote it if needed.
+     *
+     * @param[out] out output buffer
+     * @param[in] str field value
+     */
+    static void field(std::string& out, const std::string& str)
     {
-        if (!checkFilter(item))
+        if (str.find_first_of(",\"\r\n") == std::string::npos)
         {
-            continue;
+            out += str;
+            return;
         }
+        out += '"';
+        for (const char ch : str)
+        {
+            if (ch == '"')
+            {
+                out += '"';
+            }
+            out += ch;
+        }
+        out += '"';
+    }
+
+    const std::string* itemName = nullptr;
+};
+
+/**
+ * @brief Write buffer to stdout and reset it.
+ *
+ * @param[in,out] out buffer to write
+ */
+void flush(std::string& out)
+{
+    fwrite(out.data(), 1, out.size(), stdout);
+    out.clear();
+}
+
+/** @brief Min number of items in the chunk formatted by separate thread. */
+constexpr size_t minChunkSize = 256;
+
+/**
+ * @brief Get number of chunks to split the array of items.
+ *
+ * @param[in] items number of items
+ * @param[in] jobs max number of threads, 0 for all the CPUs
+ *
+ * @return number of chunks, 1 if parallel formatting is not worth it
+ */
+size_t chunkCount(size_t items, size_t jobs)
+{
+    if (!jobs)
+    {
+        jobs = std::thread::hardware_concurrency();
+    }
+    return std::max<size_t>(1, std::min(jobs, items / minChunkSize));
+}
 
-        nlohmann::json jsonItem = nlohmann::json::object();
+/**
+ * @class Pipeline
+ * @brief Output stream specialized for the set of filters and formatter.
+ */
+template <class Formatter, class ItemFilter, class PropFilter>
+class Pipeline : public Printer::Stream
+{
+  public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] fmt output formatter
+     * @param[in] itemFilter chain of item filters
+     * @param[in] propFilter chain of property filters
+     */
+    Pipeline(Formatter&& fmt, const ItemFilter& itemFilter,
+             const PropFilter& propFilter) :
+        itemFilter(itemFilter),
+        propFilter(propFilter), formatter(std::move(fmt))
+    {
+        formatter.begin(out);
+        flush(out);
+    }
+
+    void print(const InventoryItem& item) override
+    {
+        format(formatter, out, item);
+        flush(out);
+    }
 
-        // print properties
-        for (const auto& property : item.properties)
+    void print(const std::vector<InventoryItem>& items, size_t jobs) override
+    {
+        const size_t chunks = chunkCount(items.size(), jobs);
+        if constexpr (Formatter::parallel)
         {
-            nlohmann::json jsonProp;
+            if (chunks > 1)
+            {
+                printChunks(items, chunks);
+                return;
+            }
+        }
+        for (const InventoryItem& item : items)
+        {
+            print(item);
+        }
+    }
 
-            // get value from variant
-            std::visit([&jsonProp](auto&& arg) { jsonProp = arg; },
-                       property.second);
+    void finish() override
+    {
+        formatter.end(out);
+        flush(out);
+    }
 
-            const bool isEmpty =
-                (jsonProp.is_string() ? jsonProp == "" : jsonProp.empty());
-            if (!isEmpty || printEmptyProperties)
+  private:
+    /**
+     * @brief Format single item.
+     *
+     * @param[in,out] fmt formatter to use
+     * @param[out] buf output buffer
+     * @param[in] item inventory item
+     */
+    void format(Formatter& fmt, std::string& buf,
+                const InventoryItem& item) const
+    {
+        if (!itemFilter(item))
+        {
+            return;
+        }
+        fmt.beginItem(buf, item);
+        for (const auto& [name, value] : item.properties)
+        {
+            if (propFilter(value))
             {
-                jsonItem.emplace(property.first, jsonProp);
+                fmt.property(buf, name, value);
             }
         }
+        fmt.endItem(buf, item);
+    }
+
+    /**
+     * @brief Format chunks of items in parallel and write them in order.
+     *
+     * @param[in] items inventory items
+     * @param[in] chunks number of chunks
+     */
+    void printChunks(const std::vector<InventoryItem>& items, size_t chunks)
+    {
+        struct Chunk
+        {
+            Formatter formatter;
+            std::string out;
+        };
 
-        if (!jsonItem.empty())
+        const size_t chunkSize = (items.size() + chunks - 1) / chunks;
+        std::vector<std::future<Chunk>> futures;
+        futures.reserve(chunks);
+        for (size_t begin = 0; begin < items.size(); begin += chunkSize)
         {
-            json.emplace(item.name, jsonItem);
+            const size_t end = std::min(begin + chunkSize, items.size());
+            futures.emplace_back(std::async(
+                std::launch::async,
+                [this, &items, begin, end](Chunk chunk) {
+                    for (size_t i = begin; i < end; ++i)
+                    {
+                        format(chunk.formatter, chunk.out, items[i]);
+                    }
+                    return chunk;
+                },
+                Chunk{formatter, {}}));
+        }
+
+        for (std::future<Chunk>& future : futures)
+        {
+            Chunk chunk = future.get();
+            out += chunk.out;
+            formatter.merge(std::move(chunk.formatter));
+            flush(out);
         }
     }
 
-    constexpr auto JsonPrettyLookOffset = 2;
-    printf("%s\n", json.dump(JsonPrettyLookOffset).c_str());
+    ItemFilter itemFilter;
+    PropFilter propFilter;
+    Formatter formatter;
+    /** @brief Output buffer. */
+    std::string out;
+};
+
+/**
+ * @brief Select property filters and create the pipeline.
+ */
+template <class Formatter, class ItemFilter>
+std::unique_ptr<Printer::Stream> selectPropFilter(Formatter&& formatter,
+                                                  const ItemFilter& itemFilter,
+                                                  bool printEmpty)
+{
+    if (printEmpty)
+    {
+        return std::make_unique<Pipeline<Formatter, ItemFilter, Chain<>>>(
+            std::move(formatter), itemFilter, Chain<>{});
+    }
+    return std::make_unique<
+        Pipeline<Formatter, ItemFilter, Chain<NonEmptyFilter>>>(
+        std::move(formatter), itemFilter, Chain<NonEmptyFilter>{});
+}
+
+/**
+ * @brief Continue with presence filter.
+ */
+template <class Formatter, class ItemFilter>
+std::unique_ptr<Printer::Stream>
+    selectPresentFilter(Formatter&& formatter, const ItemFilter& itemFilter,
+                        bool printNonPresent, bool printEmpty)
+{
+    if (printNonPresent)
+    {
+        return selectPropFilter(std::move(formatter), itemFilter, printEmpty);
+    }
+    return selectPropFilter(std::move(formatter),
+                            itemFilter.then(PresentFilter{}), printEmpty);
+}
+
+/**
+ * @brief Continue with subtree filter.
+ */
+template <class Formatter, class ItemFilter>
+std::unique_ptr<Printer::Stream>
+    selectSubtreeFilter(Formatter&& formatter, const ItemFilter& itemFilter,
+                        const std::string& root, bool printNonPresent,
+                        bool printEmpty)
+{
+    if (root.empty())
+    {
+        return selectPresentFilter(std::move(formatter), itemFilter,
+                                   printNonPresent, printEmpty);
+    }
+    return selectPresentFilter(std::move(formatter),
+                               itemFilter.then(SubtreeFilter{root}),
+                               printNonPresent, printEmpty);
+}
+
+/**
+ * @brief Select item filters and continue with property filters.
+ *
+ * The name started with slash is treated as a full D-Bus path.
+ */
+template <class Formatter>
+std::unique_ptr<Printer::Stream>
+    selectItemFilter(Formatter&& formatter, const std::string& name,
+                     const std::string& root, bool printNonPresent,
+                     bool printEmpty)
+{
+    if (name.empty())
+    {
+        return selectSubtreeFilter(std::move(formatter), Chain<>{}, root,
+                                   printNonPresent, printEmpty);
+    }
+    if (name.front() == '/')
+    {
+        return selectSubtreeFilter(std::move(formatter),
+                                   Chain<PathFilter>{{PathFilter{name}}},
+                                   root, printNonPresent, printEmpty);
+    }
+    return selectSubtreeFilter(std::move(formatter),
+                               Chain<NameFilter>{{NameFilter{name}}}, root,
+                               printNonPresent, printEmpty);
+}
+
+} // namespace
+
+void Printer::setNameFilter(const char* name)
+{
+    nameFilter = name;
+}
+
+void Printer::allowNonPresent()
+{
+    printNonPresent = true;
+}
+
+void Printer::allowEmptyProperties()
+{
+    printEmptyProperties = true;
+}
+
+void Printer::setFormat(Format fmt)
+{
+    format = fmt;
+}
+
+void Printer::setRoot(const std::string& path)
+{
+    root = subtreeRoot(path);
+}
+
+void Printer::setJobs(size_t num)
+{
+    jobs = num;
+}
+
+std::unique_ptr<Printer::Stream> Printer::stream() const
+{
+    switch (format)
+    {
+        case Format::json:
+            return selectItemFilter(JsonFormatter{}, nameFilter, root,
+                                    printNonPresent, printEmptyProperties);
+        case Format::ndjson:
+            return selectItemFilter(NdJsonFormatter{}, nameFilter, root,
+                                    printNonPresent, printEmptyProperties);
+        case Format::csv:
+            return selectItemFilter(CsvFormatter{}, nameFilter, root,
+                                    printNonPresent, printEmptyProperties);
+        case Format::tree:
+            return selectItemFilter(TreeFormatter{root}, nameFilter, root,
+                                    printNonPresent, printEmptyProperties);
+        case Format::text:
+            return selectItemFilter(TextFormatter{}, nameFilter, root,
+                                    printNonPresent, printEmptyProperties);
+    }
+    throw std::logic_error("Unknown output format");
+}
+
+void Printer::print(const std::vector<InventoryItem>& items) const
+{
+    std::unique_ptr<Stream> output = stream();
+    output->print(items, jobs);
+    output->finish();
+}
+
+void Printer::print(const Source& source, Delivery delivery) const
+{
+    std::unique_ptr<Stream> output = stream();
+    if (delivery == Delivery::collect)
+    {
+        std::vector<InventoryItem> items;
+        source([&items](InventoryItem& item) {
+            items.emplace_back(std::move(item));
+        });
+        output->print(items, jobs);
+    }
+    else
+    {
+        const bool flushItems = delivery == Delivery::flush;
+        source([&output, flushItems](InventoryItem& item) {
+            output->print(item);
+            if (flushItems)
+            {
+                fflush(stdout);
+            }
+        });
+    }
+    output->finish();
 }
 
-bool Printer::checkFilter(const InventoryItem& item) const
+Printer::Format Printer::getFormat() const
 {
-    return
-        // filter out by name
-        (nameFilter.empty() || nameFilter == item.name) &&
-        // filter out non-present items
-        (printNonPresent || item.isPresent());
+    return format;
 }
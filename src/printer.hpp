@@ -5,6 +5,9 @@
 
 #include "inventory.hpp"
 
+#include <functional>
+#include <memory>
+
 /**
  * @class Printer
  * @brief Inventory item printer.
@@ -12,10 +15,68 @@
 class Printer
 {
   public:
+    /** @brief Output formats. */
+    enum class Format
+    {
+        text,
+        json,
+        ndjson,
+        csv,
+        tree,
+    };
+
+    /**
+     * @class Stream
+     * @brief Incremental output of inventory items.
+     */
+    class Stream
+    {
+      public:
+        virtual ~Stream() = default;
+
+        /**
+         * @brief Print single inventory item.
+         *
+         * @param[in] item inventory item to print
+         */
+        virtual void print(const InventoryItem& item) = 0;
+
+        /**
+         * @brief Print array of inventory items.
+         *
+         * Large arrays may be split into chunks formatted in parallel, the
+         * output is the same as from printing the items one by one.
+         *
+         * @param[in] items inventory items to print
+         * @param[in] jobs max number of formatting threads
+         */
+        virtual void print(const std::vector<InventoryItem>& items,
+                           size_t jobs) = 0;
+
+        /**
+         * @brief Finish output, must be called after the last item.
+         */
+        virtual void finish() = 0;
+    };
+
+    /** @brief Delivery of collected items to the output. */
+    enum class Delivery
+    {
+        /** @brief Collect all the items and print them at once. */
+        collect,
+        /** @brief Print items as they arrive. */
+        stream,
+        /** @brief Print and flush items as they arrive. */
+        flush,
+    };
+
+    /** @brief Source of items: passes all the items to the handler. */
+    using Source = std::function<void(const InventoryHandler& handler)>;
+
     /**
      * @brief Set output filter by item name.
      *
-     * @param[in] name name of the item to filter
+     * @param[in] name name of the item or its full D-Bus path to filter
      */
     void setNameFilter(const char* name);
 
@@ -30,28 +91,63 @@ class Printer
     void allowEmptyProperties();
 
     /**
-     * @brief Print list of inventory items as formatted text.
+     * @brief Set output format.
      *
-     * @param[in] items array of items to print
+     * @param[in] fmt output format
+     */
+    void setFormat(Format fmt);
+
+    /**
+     * @brief Set root of the inventory subtree to print.
+     *
+     * Items outside of the subtree are skipped, hierarchical output starts
+     * from the root. Trailing slashes are ignored, so "/" is the whole tree.
+     *
+     * @param[in] path D-Bus path of the subtree's root
+     */
+    void setRoot(const std::string& path);
+
+    /**
+     * @brief Set max number of threads used to format large lists.
+     *
+     * @param[in] num number of threads, 0 to use all the CPUs
      */
-    void printText(const std::vector<InventoryItem>& items) const;
+    void setJobs(size_t num);
 
     /**
-     * @brief Print list of inventory items as JSON text.
+     * @brief Create output stream for the current format and filters.
+     *
+     * The stream refers to the printer's filters, so the printer must
+     * outlive it.
+     *
+     * @return output stream
+     */
+    std::unique_ptr<Stream> stream() const;
+
+    /**
+     * @brief Print list of inventory items in the current format.
      *
      * @param[in] items array of items to print
      */
-    void printJson(const std::vector<InventoryItem>& items) const;
+    void print(const std::vector<InventoryItem>& items) const;
 
-  private:
     /**
-     * @brief Pass item through filter.
+     * @brief Print items from the source in the current format.
+     *
+     * Collected items are formatted in parallel if there are many of them,
+     * streamed items are printed one by one.
      *
-     * @param[in] item inventory item to check
+     * @param[in] source source of items
+     * @param[in] delivery delivery of items to the output
+     */
+    void print(const Source& source, Delivery delivery) const;
+
+    /**
+     * @brief Get output format.
      *
-     * @return true if item should be printed out
+     * @return output format
      */
-    bool checkFilter(const InventoryItem& item) const;
+    Format getFormat() const;
 
   private:
     /** @brief Filter for item name. */
@@ -60,4 +156,10 @@ class Printer
     bool printNonPresent = false;
     /** @brief Allow printing of empty properties. */
     bool printEmptyProperties = false;
+    /** @brief Output format. */
+    Format format = Format::text;
+    /** @brief Root path of the subtree to print. */
+    std::string root;
+    /** @brief Max number of formatting threads, 0 for all CPUs. */
+    size_t jobs = 0;
 };
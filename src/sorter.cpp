@@ -0,0 +1,370 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#include "sorter.hpp"
+
+#include "history.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <queue>
+#include <stdexcept>
+
+/**
+ * @brief Estimate memory used by the item.
+ *
+ * @param[in] item inventory item
+ *
+ * @return size in bytes, including container allocations
+ */
+static size_t itemSize(const InventoryItem& item)
+{
+    // allocation overhead of a map node
+    static constexpr size_t nodeOverhead = 48;
+
+    size_t size =
+        sizeof(InventoryItem) + item.name.capacity() + item.path.capacity();
+    for (const auto& [name, value] : item.properties)
+    {
+        size += nodeOverhead + sizeof(name) + sizeof(value) + name.capacity();
+        const std::string* str = std::get_if<std::string>(&value);
+        if (str)
+        {
+            size += str->capacity();
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Compare items by name.
+ */
+static bool nameLess(const InventoryItem& a, const InventoryItem& b)
+{
+    return humanCompare(a.name, b.name);
+}
+
+/**
+ * @brief Write item to the run file.
+ *
+ * The item is written as its name and path followed by property lines and
+ * terminated by an empty line, fields are separated by tabs.
+ *
+ * @param[in] file run file
+ * @param[in] item inventory item
+ *
+ * @return false on write error
+ */
+static bool writeItem(FILE* file, const InventoryItem& item)
+{
+    std::string out = escape(item.name);
+    out += '\t';
+    out += escape(item.path);
+    out += '\n';
+    for (const auto& [name, value] : item.properties)
+    {
+        out += escape(name);
+        out += '\t';
+        out += encodeValue(value);
+        out += '\n';
+    }
+    out += '\n';
+    return fwrite(out.data(), 1, out.size(), file) == out.size();
+}
+
+/**
+ * @brief Create temporary file.
+ *
+ * @return file opened for reading and writing, removed on close
+ *
+ * @throw std::runtime_error if the file can not be created
+ */
+static FILE* createFile()
+{
+    FILE* file = tmpfile();
+    if (!file)
+    {
+        throw std::runtime_error("Unable to create sort run file");
+    }
+    return file;
+}
+
+/**
+ * @brief Get end of the file content written so far.
+ *
+ * @param[in] file file to check
+ *
+ * @return offset of the end
+ *
+ * @throw std::runtime_error on write error
+ */
+static off_t flushedEnd(FILE* file)
+{
+    if (fflush(file) != 0)
+    {
+        throw std::runtime_error("Unable to write sort run file");
+    }
+    return ftello(file);
+}
+
+/**
+ * @class RunReader
+ * @brief Buffered reader of a single run from the shared run file.
+ */
+class RunReader
+{
+  public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] file run file
+     * @param[in] begin offset of the run
+     * @param[in] end end offset of the run
+     */
+    RunReader(FILE* file, off_t begin, off_t end) :
+        fd(fileno(file)), pos(begin), end(end)
+    {}
+
+    /**
+     * @brief Read next item of the run.
+     *
+     * @param[out] item inventory item
+     *
+     * @return false on end of the run
+     *
+     * @throw std::runtime_error if the run is malformed
+     */
+    bool next(InventoryItem& item)
+    {
+        item = InventoryItem();
+
+        std::string line;
+        if (!readLine(line))
+        {
+            return false;
+        }
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos)
+        {
+            throw std::runtime_error("Invalid sort run record: " + line);
+        }
+        item.name = unescape(line.substr(0, tab));
+        item.path = unescape(line.substr(tab + 1));
+
+        while (readLine(line) && !line.empty())
+        {
+            tab = line.find('\t');
+            if (tab == std::string::npos)
+            {
+                throw std::runtime_error("Invalid sort run record: " + line);
+            }
+            item.properties.emplace(unescape(line.substr(0, tab)),
+                                    decodeValue(line.substr(tab + 1)));
+        }
+
+        return true;
+    }
+
+  private:
+    /**
+     * @brief Read line from the run.
+     *
+     * @param[out] line line without new line character
+     *
+     * @return false on end of the run
+     */
+    bool readLine(std::string& line)
+    {
+        // size of the read buffer
+        static constexpr size_t chunkSize = 4096;
+
+        size_t eol;
+        while ((eol = buf.find('\n', bufPos)) == std::string::npos &&
+               pos < end)
+        {
+            buf.erase(0, bufPos);
+            bufPos = 0;
+            const size_t size = buf.size();
+            buf.resize(size + std::min<off_t>(chunkSize, end - pos));
+            const ssize_t rc = pread(fd, &buf[size], buf.size() - size, pos);
+            if (rc <= 0)
+            {
+                throw std::runtime_error("Unable to read sort run file");
+            }
+            buf.resize(size + rc);
+            pos += rc;
+        }
+        if (eol == std::string::npos)
+        {
+            eol = buf.size();
+            if (eol == bufPos)
+            {
+                return false;
+            }
+        }
+        line.assign(buf, bufPos, eol - bufPos);
+        bufPos = std::min(eol + 1, buf.size());
+        return true;
+    }
+
+    /** @brief File descriptor of the run file. */
+    int fd;
+    /** @brief Current offset in the file. */
+    off_t pos;
+    /** @brief End offset of the run. */
+    off_t end;
+    /** @brief Read buffer. */
+    std::string buf;
+    /** @brief Position of the unread data in the buffer. */
+    size_t bufPos = 0;
+};
+
+ExternalSorter::ExternalSorter(size_t budget) : budget(budget)
+{}
+
+ExternalSorter::~ExternalSorter()
+{
+    for (FILE* f : {file, spare})
+    {
+        if (f)
+        {
+            fclose(f);
+        }
+    }
+}
+
+void ExternalSorter::add(InventoryItem&& item)
+{
+    used += itemSize(item);
+    items.emplace_back(std::move(item));
+    if (used > budget)
+    {
+        spill();
+    }
+}
+
+void ExternalSorter::merge(const InventoryHandler& handler)
+{
+    if (sortedRuns.empty())
+    {
+        // everything fits in memory
+        std::stable_sort(items.begin(), items.end(), nameLess);
+        for (InventoryItem& item : items)
+        {
+            handler(item);
+        }
+        items.clear();
+        used = 0;
+        return;
+    }
+
+    if (!items.empty())
+    {
+        spill();
+    }
+
+    // merge groups of adjacent runs into the spare file until all the
+    // runs can be merged at once, adjacent runs keep order of arrival
+    while (sortedRuns.size() > MaxFanIn)
+    {
+        if (!spare)
+        {
+            spare = createFile();
+        }
+        std::vector<Run> merged;
+        for (size_t first = 0; first < sortedRuns.size(); first += MaxFanIn)
+        {
+            const size_t last =
+                std::min(first + MaxFanIn, sortedRuns.size());
+            Run run;
+            run.begin = flushedEnd(spare);
+            mergeRuns(first, last, [this](InventoryItem& item) {
+                if (!writeItem(spare, item))
+                {
+                    throw std::runtime_error("Unable to write sort run file");
+                }
+            });
+            run.end = flushedEnd(spare);
+            merged.push_back(run);
+        }
+
+        // reuse the source file for the next pass
+        if (ftruncate(fileno(file), 0) != 0 || fseeko(file, 0, SEEK_SET) != 0)
+        {
+            throw std::runtime_error("Unable to write sort run file");
+        }
+        std::swap(file, spare);
+        sortedRuns = std::move(merged);
+    }
+
+    mergeRuns(0, sortedRuns.size(), handler);
+}
+
+size_t ExternalSorter::runs() const
+{
+    return spilled;
+}
+
+void ExternalSorter::spill()
+{
+    if (!file)
+    {
+        file = createFile();
+    }
+
+    std::stable_sort(items.begin(), items.end(), nameLess);
+    Run run;
+    run.begin = flushedEnd(file);
+    for (const InventoryItem& item : items)
+    {
+        if (!writeItem(file, item))
+        {
+            throw std::runtime_error("Unable to write sort run file");
+        }
+    }
+    run.end = flushedEnd(file);
+    sortedRuns.push_back(run);
+    ++spilled;
+
+    items.clear();
+    used = 0;
+}
+
+void ExternalSorter::mergeRuns(size_t first, size_t last,
+                               const InventoryHandler& handler) const
+{
+    // k-way merge, equal names are taken from the earliest run first
+    std::vector<RunReader> readers;
+    std::vector<InventoryItem> heads(last - first);
+    readers.reserve(last - first);
+    auto greater = [&heads](size_t a, size_t b) {
+        if (nameLess(heads[b], heads[a]))
+        {
+            return true;
+        }
+        return !nameLess(heads[a], heads[b]) && a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> queue(
+        greater);
+
+    for (size_t i = first; i < last; ++i)
+    {
+        RunReader& reader = readers.emplace_back(file, sortedRuns[i].begin,
+                                                 sortedRuns[i].end);
+        if (reader.next(heads[i - first]))
+        {
+            queue.push(i - first);
+        }
+    }
+    while (!queue.empty())
+    {
+        const size_t run = queue.top();
+        queue.pop();
+        handler(heads[run]);
+        if (readers[run].next(heads[run]))
+        {
+            queue.push(run);
+        }
+    }
+}
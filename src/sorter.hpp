@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#pragma once
+
+#include "inventory.hpp"
+
+#include <sys/types.h>
+
+#include <cstdio>
+
+/**
+ * @class ExternalSorter
+ * @brief Sorter of inventory items by name with bounded memory usage.
+ *
+ * Items are buffered until their estimated size exceeds the memory budget,
+ * then the buffer is sorted and spilled to a temporary file as a sorted run.
+ * The runs are merged in human readable order of names, items with equal
+ * names are passed in order of arrival. At most MaxFanIn runs are merged at
+ * once, more runs are merged in several passes. Temporary files are created
+ * in P_tmpdir, which is tmpfs on BMC.
+ */
+class ExternalSorter
+{
+  public:
+    /**
+     * @brief Constructor.
+     *
+     * @param[in] budget max size of the buffered items in bytes
+     */
+    explicit ExternalSorter(size_t budget);
+
+    ~ExternalSorter();
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    /**
+     * @brief Add item to sort.
+     *
+     * @param[in] item inventory item
+     *
+     * @throw std::runtime_error if a run can not be written
+     */
+    void add(InventoryItem&& item);
+
+    /**
+     * @brief Pass all the added items to the handler in sorted order.
+     *
+     * @param[in] handler callback for inventory items
+     *
+     * @throw std::runtime_error if a run can not be written or read
+     */
+    void merge(const InventoryHandler& handler);
+
+    /**
+     * @brief Get number of runs spilled to temporary files.
+     *
+     * @return number of runs
+     */
+    size_t runs() const;
+
+    /** @brief Max number of runs merged at once. */
+    static constexpr size_t MaxFanIn = 16;
+
+  private:
+    /** @brief Sorted run: range of a temporary file. */
+    struct Run
+    {
+        off_t begin;
+        off_t end;
+    };
+
+    /**
+     * @brief Sort buffered items and append them to the run file.
+     */
+    void spill();
+
+    /**
+     * @brief Merge runs from the run file.
+     *
+     * @param[in] first index of the first run to merge
+     * @param[in] last index after the last run to merge
+     * @param[in] handler callback for merged items
+     */
+    void mergeRuns(size_t first, size_t last,
+                   const InventoryHandler& handler) const;
+
+    /** @brief Memory budget in bytes. */
+    size_t budget;
+    /** @brief Estimated size of the buffered items. */
+    size_t used = 0;
+    /** @brief Buffered items. */
+    std::vector<InventoryItem> items;
+    /** @brief File with sorted runs. */
+    FILE* file = nullptr;
+    /** @brief Spare file for intermediate merge passes. */
+    FILE* spare = nullptr;
+    /** @brief Sorted runs in order of arrival. */
+    std::vector<Run> sortedRuns;
+    /** @brief Total number of spilled runs. */
+    size_t spilled = 0;
+};
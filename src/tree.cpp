@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#include "tree.hpp"
+
+bool InventoryTree::HumanLess::operator()(const std::string& a,
+                                          const std::string& b) const
+{
+    // human comparison treats "cpu01" and "cpu1" as equal
+    return humanCompare(a, b) || (!humanCompare(b, a) && a < b);
+}
+
+void InventoryTree::add(InventoryItem&& item)
+{
+    Node* node = &root;
+
+    size_t start = 0;
+    while (start < item.path.length())
+    {
+        size_t end = item.path.find('/', start);
+        if (end == std::string::npos)
+        {
+            end = item.path.length();
+        }
+        if (end != start)
+        {
+            auto& child = node->children[item.path.substr(start, end - start)];
+            if (!child)
+            {
+                child = std::make_unique<Node>();
+            }
+            node = child.get();
+        }
+        start = end + 1;
+    }
+
+    if (node->item)
+    {
+        node->item->merge(item.properties);
+    }
+    else
+    {
+        node->item = std::make_unique<InventoryItem>(std::move(item));
+    }
+}
+
+void InventoryTree::walk(const InventoryHandler& handler)
+{
+    walk(root, handler);
+}
+
+void InventoryTree::walk(Node& node, const InventoryHandler& handler)
+{
+    if (node.item)
+    {
+        handler(*node.item);
+    }
+    for (auto& [_, child] : node.children)
+    {
+        walk(*child, handler);
+    }
+}
@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#pragma once
+
+#include "inventory.hpp"
+
+#include <memory>
+
+/**
+ * @class InventoryTree
+ * @brief Prefix tree of inventory items indexed by their D-Bus paths.
+ */
+class InventoryTree
+{
+  public:
+    /**
+     * @brief Add item to the tree.
+     *
+     * Properties of items with the same path are merged.
+     *
+     * @param[in] item inventory item, its path is used as a key
+     */
+    void add(InventoryItem&& item);
+
+    /**
+     * @brief Pass all items to the handler in depth-first order.
+     *
+     * Parent goes before its children, siblings are passed in human readable
+     * order.
+     *
+     * @param[in] handler callback for inventory items
+     */
+    void walk(const InventoryHandler& handler);
+
+  private:
+    /**
+     * struct HumanLess
+     * @brief Strict ordering of path components.
+     */
+    struct HumanLess
+    {
+        bool operator()(const std::string& a, const std::string& b) const;
+    };
+
+    /**
+     * struct Node
+     * @brief Tree node, one per path component.
+     */
+    struct Node
+    {
+        /** @brief Inventory item, absent for intermediate nodes. */
+        std::unique_ptr<InventoryItem> item;
+        /** @brief Child nodes. */
+        std::map<std::string, std::unique_ptr<Node>, HumanLess> children;
+    };
+
+    /**
+     * @brief Pass items of the subtree to the handler.
+     *
+     * @param[in] node root node of the subtree
+     * @param[in] handler callback for inventory items
+     */
+    static void walk(Node& node, const InventoryHandler& handler);
+
+    /** @brief Root node. */
+    Node root;
+};
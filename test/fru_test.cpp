@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#include "config.hpp"
+#include "fru.hpp"
+
+#include <gtest/gtest.h>
+
+// FRU_TEST_DIR contains fixture EEPROM devices:
+// 1-0050 - valid image with chassis, board and product areas,
+// 2-0051 - image without valid common header,
+// 3-0052 - device without EEPROM.
+
+TEST(FruTest, Inventory)
+{
+    std::vector<InventoryItem> items = getFruInventory(FRU_TEST_DIR);
+    ASSERT_EQ(items.size(), 1u);
+
+    const InventoryItem& item = items[0];
+    EXPECT_EQ(item.name, "fru-1-0050");
+    EXPECT_EQ(item.path, INVENTORY_PATH "/fru/1_0050");
+
+    // clang-format off
+    const std::map<std::string, InventoryItem::PropValue> expected = {
+        {"AssetTag",     std::string("")}, // empty fields are skipped
+        {"BuildDate",    std::string("2020-01-01 00:00:00")},
+        {"ChassisType",  uint8_t(0x17)},
+        {"Manufacturer", std::string("YADRO")},
+        {"Model",        std::string("12-34")},
+        {"PartNumber",   std::string("PN-42B")},
+        {"PrettyName",   std::string("VEGMAN S220")},
+        {"SerialNumber", std::string("PRD0001")},
+        {"Version",      std::string("v1")},
+    };
+    // clang-format on
+
+    EXPECT_EQ(item.properties.size(), expected.size() - 1);
+    for (const auto& [name, value] : expected)
+    {
+        const auto it = item.properties.find(name);
+        if (name == "AssetTag")
+        {
+            EXPECT_EQ(it, item.properties.end());
+            continue;
+        }
+        ASSERT_NE(it, item.properties.end()) << name;
+        EXPECT_EQ(it->second, value) << name;
+    }
+}
+
+TEST(FruTest, InvalidHeader)
+{
+    InventoryItem::Properties properties;
+    std::vector<uint8_t> data = {0x01, 0x00, 0x00, 0x00,
+                                 0x00, 0x00, 0x00, 0xff};
+    EXPECT_TRUE(parseFru(data, properties));
+    EXPECT_TRUE(properties.empty());
+
+    // invalid checksum
+    data[7] = 0xfe;
+    EXPECT_FALSE(parseFru(data, properties));
+
+    // unsupported format version
+    data[0] = 0x02;
+    EXPECT_FALSE(parseFru(data, properties));
+
+    // truncated header
+    data.resize(4);
+    EXPECT_FALSE(parseFru(data, properties));
+}
+
+TEST(FruTest, Merge)
+{
+    std::vector<InventoryItem> items(2);
+    items[0].name = "motherboard";
+    items[0].properties["SerialNumber"] = std::string("PRD0001");
+    items[0].properties["PrettyName"] = std::string("Motherboard");
+    items[1].name = "cpu0";
+
+    std::vector<InventoryItem> fru(2);
+    fru[0].name = "fru-1-0050";
+    fru[0].properties["SerialNumber"] = std::string("PRD0001");
+    fru[0].properties["PrettyName"] = std::string("VEGMAN S220");
+    fru[0].properties["Model"] = std::string("12-34");
+    fru[1].name = "fru-2-0051";
+    fru[1].properties["SerialNumber"] = std::string("PRD0002");
+
+    mergeFruInventory(items, std::move(fru));
+    ASSERT_EQ(items.size(), 3u);
+    EXPECT_EQ(items[0].properties.size(), 3u);
+    EXPECT_EQ(std::get<std::string>(items[0].properties["PrettyName"]),
+              "Motherboard");
+    EXPECT_EQ(std::get<std::string>(items[0].properties["Model"]), "12-34");
+    EXPECT_EQ(items[2].name, "fru-2-0051");
+}
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#include "history.hpp"
+
+#include <unistd.h>
+
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+/**
+ * class HistoryTest
+ * @brief History tests.
+ */
+class HistoryTest : public ::testing::Test
+{
+  protected:
+    HistoryTest()
+    {
+        char tmpl[] = "/tmp/lsinventory_history_XXXXXX";
+        const int fd = mkstemp(tmpl);
+        EXPECT_NE(fd, -1);
+        close(fd);
+        file = tmpl;
+    }
+
+    ~HistoryTest()
+    {
+        unlink(file.c_str());
+    }
+
+    /**
+     * @brief Create inventory item.
+     */
+    static InventoryItem item(const char* path, const char* name,
+                              InventoryItem::Properties props)
+    {
+        InventoryItem item;
+        item.path = path;
+        item.name = name;
+        item.properties = std::move(props);
+        return item;
+    }
+
+    /**
+     * @brief Count records of specified type.
+     */
+    size_t count(char type)
+    {
+        std::ifstream stream(file);
+        std::string line;
+        size_t num = 0;
+        while (std::getline(stream, line))
+        {
+            num += line[0] == type;
+        }
+        return num;
+    }
+
+    std::string file;
+};
+
+TEST_F(HistoryTest, Empty)
+{
+    History history(file);
+    EXPECT_TRUE(history.at(1000).empty());
+}
+
+TEST_F(HistoryTest, PointInTime)
+{
+    History history(file);
+
+    std::vector<InventoryItem> items = {
+        item("/inv/cpu0", "cpu0",
+             {{"Present", true}, {"Model", std::string("Xeon\tE5\\n")}}),
+        item("/inv/dimm0", "dimm0", {{"Size", uint32_t(16)}}),
+    };
+    EXPECT_EQ(history.record(items, 100), 2u);
+    EXPECT_EQ(history.record(items, 200), 0u);
+
+    items[0].properties.erase("Model");
+    items[1].properties["Size"] = uint32_t(32);
+    items.push_back(item("/inv/drive0", "drive0", {{"Temp", int64_t(-5)}}));
+    EXPECT_EQ(history.record(items, 300), 3u);
+
+    items.erase(items.begin());
+    EXPECT_EQ(history.record(items, 400), 1u);
+
+    EXPECT_EQ(count('C'), 1u);
+    EXPECT_EQ(count('D'), 2u);
+
+    EXPECT_TRUE(history.at(99).empty());
+
+    std::vector<InventoryItem> state = history.at(250);
+    ASSERT_EQ(state.size(), 2u);
+    EXPECT_EQ(state[0].name, "cpu0");
+    EXPECT_EQ(state[0].path, "/inv/cpu0");
+    EXPECT_EQ(std::get<std::string>(state[0].properties["Model"]),
+              "Xeon\tE5\\n");
+    EXPECT_EQ(std::get<uint32_t>(state[1].properties["Size"]), 16u);
+
+    state = history.at(300);
+    ASSERT_EQ(state.size(), 3u);
+    EXPECT_EQ(state[0].properties.size(), 1u);
+    EXPECT_EQ(std::get<uint32_t>(state[1].properties["Size"]), 32u);
+    EXPECT_EQ(std::get<int64_t>(state[2].properties["Temp"]), -5);
+
+    state = history.at(1000);
+    ASSERT_EQ(state.size(), 2u);
+    EXPECT_EQ(state[0].name, "dimm0");
+    EXPECT_EQ(state[1].name, "drive0");
+}
+
+TEST_F(HistoryTest, Checkpoint)
+{
+    History history(file);
+
+    std::vector<InventoryItem> items = {
+        item("/inv/cpu0", "cpu0", {{"Counter", uint64_t(0)}}),
+    };
+    // checkpoint, CheckpointInterval deltas, checkpoint, ..., checkpoint
+    const size_t records = (History::CheckpointInterval + 1) * 2 + 1;
+    for (size_t i = 0; i < records; ++i)
+    {
+        items[0].properties["Counter"] = uint64_t(i);
+        history.record(items, static_cast<time_t>(i));
+    }
+
+    EXPECT_EQ(count('C'), 3u);
+    EXPECT_EQ(count('D'), records - 3);
+
+    for (size_t i = 0; i < records; ++i)
+    {
+        std::vector<InventoryItem> state =
+            history.at(static_cast<time_t>(i));
+        ASSERT_EQ(state.size(), 1u);
+        EXPECT_EQ(std::get<uint64_t>(state[0].properties["Counter"]), i);
+    }
+}
+
+TEST_F(HistoryTest, Missing)
+{
+    unlink(file.c_str());
+    History history(file);
+    EXPECT_THROW(history.at(1000), std::runtime_error);
+}
+
+TEST_F(HistoryTest, Truncated)
+{
+    History history(file);
+
+    std::vector<InventoryItem> items = {
+        item("/inv/cpu0", "cpu0", {{"Model", std::string("Xeon")}}),
+    };
+    EXPECT_EQ(history.record(items, 100), 1u);
+
+    // interrupted write of the next delta
+    {
+        std::ofstream stream(file, std::ios::app);
+        stream << "D\t200\n=\t/inv/cpu0\tModel";
+    }
+    std::vector<InventoryItem> state = history.at(1000);
+    ASSERT_EQ(state.size(), 1u);
+    EXPECT_EQ(std::get<std::string>(state[0].properties["Model"]), "Xeon");
+
+    // the tail is dropped by the next record
+    items[0].properties["Model"] = std::string("Epyc");
+    EXPECT_EQ(history.record(items, 300), 1u);
+    EXPECT_EQ(count('D'), 1u);
+    state = history.at(1000);
+    ASSERT_EQ(state.size(), 1u);
+    EXPECT_EQ(std::get<std::string>(state[0].properties["Model"]), "Epyc");
+    state = history.at(250);
+    ASSERT_EQ(state.size(), 1u);
+    EXPECT_EQ(std::get<std::string>(state[0].properties["Model"]), "Xeon");
+}
+
+TEST(HistoryValueTest, Encoding)
+{
+    const InventoryItem::PropValue values[] = {
+        int64_t(-42),
+        uint64_t(42),
+        uint32_t(42),
+        uint16_t(42),
+        uint8_t(42),
+        std::string("a\tb\\"),
+        true,
+        false,
+    };
+    for (const auto& value : values)
+    {
+        const std::string encoded = encodeValue(value);
+        EXPECT_EQ(encoded.find_first_of("\t\n"), std::string::npos);
+        EXPECT_EQ(decodeValue(encoded), value);
+    }
+    EXPECT_THROW(decodeValue("xNaN"), std::runtime_error);
+}
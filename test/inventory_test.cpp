@@ -20,8 +20,62 @@ class InventoryTest : public ::testing::Test
     InventoryTest() : bus(sdbusplus::get_mocked_new(&mock))
     {}
 
+    /**
+     * @brief Mock GetSubTree reply with specified objects without
+     *        properties, record strings appended to method calls.
+     *
+     * @param[in] paths D-Bus paths of the objects
+     */
+    void mockSubTree(const std::vector<const char*>& paths)
+    {
+        // "end-of-array" flag, every second call is for an empty map of
+        // services, see FullList test
+        EXPECT_CALL(mock, sd_bus_message_at_end)
+            .WillRepeatedly(Invoke([this, paths](sd_bus_message*, int) {
+                const size_t index = atEndCalls / 2;
+                const bool hasData =
+                    atEndCalls % 2 == 0 && index < paths.size();
+                ++atEndCalls;
+                return hasData ? 0 : 1;
+            }));
+        EXPECT_CALL(mock, sd_bus_message_read_basic(_, 's', _))
+            .WillRepeatedly(
+                Invoke([this, paths](sd_bus_message*, char, void* p) {
+                    const char** s = static_cast<const char**>(p);
+                    *s = readCalls < paths.size() ? paths[readCalls]
+                                                  : "<ERR>";
+                    ++readCalls;
+                    return 0;
+                }));
+        EXPECT_CALL(mock, sd_bus_message_append_basic(_, 's', _))
+            .WillRepeatedly(
+                Invoke([this](sd_bus_message*, char, const void* p) {
+                    appended.emplace_back(static_cast<const char*>(p));
+                    return 0;
+                }));
+    }
+
+    /**
+     * @brief Get names of the items passed to the handler.
+     *
+     * @param[in] options collection options
+     *
+     * @return item names in order of handling
+     */
+    std::vector<std::string> getNames(const InventoryOptions& options)
+    {
+        std::vector<std::string> names;
+        getInventory(bus, options, [&names](InventoryItem& item) {
+            names.emplace_back(item.name);
+        });
+        return names;
+    }
+
     testing::NiceMock<sdbusplus::SdBusMock> mock;
     sdbusplus::bus::bus bus;
+    size_t atEndCalls = 0;
+    size_t readCalls = 0;
+    std::vector<std::string> appended;
 };
 
 TEST_F(InventoryTest, EmptyList)
@@ -267,3 +321,119 @@ TEST_F(InventoryTest, StringProperty)
     EXPECT_EQ(item.properties.size(), 1);
     EXPECT_EQ(item.prettyName(), valResult);
 }
+
+TEST_F(InventoryTest, SubtreeRoot)
+{
+    mockSubTree({
+        "/xyz/openbmc_project/inventory/system/chassis/cpu0/core1",
+        "/xyz/openbmc_project/inventory/system/chassis/cpu1",
+        "/xyz/openbmc_project/inventory/system/chassis/cpu0",
+    });
+
+    InventoryOptions options;
+    options.root = "/xyz/openbmc_project/inventory/system/chassis/cpu0";
+    const std::vector<std::string> names = getNames(options);
+
+    // mapper skips the requested root, so its parent is queried
+    ASSERT_FALSE(appended.empty());
+    EXPECT_EQ(appended.front(),
+              "/xyz/openbmc_project/inventory/system/chassis");
+    EXPECT_EQ(names, std::vector<std::string>({"cpu0", "cpu0/core1"}));
+}
+
+TEST_F(InventoryTest, WholeTree)
+{
+    mockSubTree({});
+    EXPECT_TRUE(getNames(InventoryOptions()).empty());
+    ASSERT_FALSE(appended.empty());
+    EXPECT_EQ(appended.front(), "/xyz/openbmc_project/inventory");
+}
+
+TEST_F(InventoryTest, VerboseMapper)
+{
+    mockSubTree({
+        "/xyz/openbmc_project/inventory/system/chassis/cpu0",
+        "/xyz/openbmc_project/inventory/system/chassis/cpu1",
+    });
+
+    InventoryOptions options;
+    options.verbose = true;
+    testing::internal::CaptureStderr();
+    getNames(options);
+    EXPECT_EQ(testing::internal::GetCapturedStderr(),
+              "Object mapper found 2 inventory objects\n");
+}
+
+TEST(InventoryServicesTest, Select)
+{
+    const std::vector<InventoryService> services = {
+        {"com.example.Absent", "/xyz/openbmc_project/inventory"},
+        {"com.example.Board", "/xyz/openbmc_project/inventory/system"},
+        {"com.example.Cpu", "/xyz/openbmc_project/inventory/system/cpu0"},
+        {"com.example.Root", "/"},
+        {"com.example.Sensor", "/xyz/openbmc_project/sensors"},
+    };
+    const std::unordered_set<std::string> busNames = {
+        "com.example.Board",
+        "com.example.Cpu",
+        "com.example.Root",
+        "com.example.Sensor",
+        "org.freedesktop.DBus",
+    };
+
+    InventoryOptions options;
+    options.root = "/xyz/openbmc_project/inventory/system";
+    options.verbose = true;
+    testing::internal::CaptureStderr();
+    const std::vector<InventoryService> selected =
+        selectServices(services, busNames, options);
+    EXPECT_EQ(testing::internal::GetCapturedStderr(),
+              "Skip absent service com.example.Absent\n"
+              "Query service com.example.Board\n"
+              "Query service com.example.Cpu\n"
+              "Query service com.example.Root\n");
+    EXPECT_EQ(selected, std::vector<InventoryService>(services.begin() + 1,
+                                                      services.begin() + 4));
+}
+
+/**
+ * class InventoryOrderTest
+ * @brief Inventory tests for the order of items.
+ */
+class InventoryOrderTest : public InventoryTest
+{
+  protected:
+    InventoryOrderTest()
+    {
+        mockSubTree({
+            "/xyz/openbmc_project/inventory/system/chassis/cpu2",
+            "/xyz/openbmc_project/inventory/system/chassis/cpu10",
+            "/xyz/openbmc_project/inventory/system/board/dimm0",
+        });
+    }
+};
+
+TEST_F(InventoryOrderTest, Name)
+{
+    InventoryOptions options;
+    options.order = InventoryOptions::Order::name;
+    EXPECT_EQ(getNames(options),
+              std::vector<std::string>({"cpu2", "cpu10", "dimm0"}));
+}
+
+TEST_F(InventoryOrderTest, Path)
+{
+    InventoryOptions options;
+    options.order = InventoryOptions::Order::path;
+    EXPECT_EQ(getNames(options),
+              std::vector<std::string>({"dimm0", "cpu2", "cpu10"}));
+}
+
+TEST_F(InventoryOrderTest, None)
+{
+    // order of the mapper reply, which is sorted as strings
+    InventoryOptions options;
+    options.order = InventoryOptions::Order::none;
+    EXPECT_EQ(getNames(options),
+              std::vector<std::string>({"dimm0", "cpu10", "cpu2"}));
+}
@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#include "printer.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <gtest/gtest.h>
+
+/**
+ * class PrinterTest
+ * @brief Printer tests.
+ */
+class PrinterTest : public ::testing::Test
+{
+  protected:
+    PrinterTest()
+    {
+        InventoryItem cpu;
+        cpu.name = "cpu0";
+        cpu.properties["PrettyName"] = std::string("CPU, \"main\"");
+        cpu.properties["Present"] = true;
+        cpu.properties["SerialNumber"] = std::string("");
+        cpu.properties["Cores"] = uint32_t(8);
+        items.emplace_back(cpu);
+
+        InventoryItem dimm;
+        dimm.name = "dimm1";
+        dimm.properties["Present"] = false;
+        items.emplace_back(dimm);
+    }
+
+    /**
+     * @brief Print items and capture output.
+     *
+     * @return printed text
+     */
+    std::string print()
+    {
+        testing::internal::CaptureStdout();
+        printer.print(items);
+        return testing::internal::GetCapturedStdout();
+    }
+
+    Printer printer;
+    std::vector<InventoryItem> items;
+};
+
+TEST_F(PrinterTest, Text)
+{
+    EXPECT_EQ(print(), "cpu0: CPU, \"main\"\n"
+                       "  Cores:                8\n"
+                       "  Present:              Yes\n"
+                       "  PrettyName:           CPU, \"main\"\n");
+}
+
+TEST_F(PrinterTest, TextAll)
+{
+    printer.allowNonPresent();
+    printer.allowEmptyProperties();
+    EXPECT_EQ(print(), "cpu0: CPU, \"main\"\n"
+                       "  Cores:                8\n"
+                       "  Present:              Yes\n"
+                       "  PrettyName:           CPU, \"main\"\n"
+                       "  SerialNumber:         \n"
+                       "dimm1: \n"
+                       "  Present:              No\n");
+}
+
+TEST_F(PrinterTest, NameFilter)
+{
+    printer.setNameFilter("dimm1");
+    EXPECT_EQ(print(), "");
+    printer.allowNonPresent();
+    EXPECT_EQ(print(), "dimm1: \n"
+                       "  Present:              No\n");
+}
+
+TEST_F(PrinterTest, Json)
+{
+    printer.setFormat(Printer::Format::json);
+    EXPECT_EQ(print(), "{\n"
+                       "  \"cpu0\": {\n"
+                       "    \"Cores\": 8,\n"
+                       "    \"Present\": true,\n"
+                       "    \"PrettyName\": \"CPU, \\\"main\\\"\"\n"
+                       "  }\n"
+                       "}\n");
+}
+
+TEST_F(PrinterTest, JsonEmpty)
+{
+    printer.setFormat(Printer::Format::json);
+    printer.setNameFilter("none");
+    EXPECT_EQ(print(), "{}\n");
+}
+
+TEST_F(PrinterTest, NdJson)
+{
+    printer.setFormat(Printer::Format::ndjson);
+    printer.allowNonPresent();
+    EXPECT_EQ(print(),
+              "{\"name\":\"cpu0\",\"properties\":{\"Cores\":8,"
+              "\"Present\":true,\"PrettyName\":\"CPU, \\\"main\\\"\"}}\n"
+              "{\"name\":\"dimm1\",\"properties\":{\"Present\":false}}\n");
+}
+
+TEST_F(PrinterTest, Csv)
+{
+    printer.setFormat(Printer::Format::csv);
+    EXPECT_EQ(print(), "Item,Property,Value\n"
+                       "cpu0,Cores,8\n"
+                       "cpu0,Present,Yes\n"
+                       "cpu0,PrettyName,\"CPU, \"\"main\"\"\"\n");
+}
+
+TEST_F(PrinterTest, Stream)
+{
+    printer.setFormat(Printer::Format::csv);
+
+    // each item is written as soon as it is printed
+    testing::internal::CaptureStdout();
+    std::unique_ptr<Printer::Stream> output = printer.stream();
+    output->print(items[0]);
+    fflush(stdout);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+              "Item,Property,Value\n"
+              "cpu0,Cores,8\n"
+              "cpu0,Present,Yes\n"
+              "cpu0,PrettyName,\"CPU, \"\"main\"\"\"\n");
+
+    testing::internal::CaptureStdout();
+    output->print(items[1]);
+    output->finish();
+    fflush(stdout);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+}
+
+TEST_F(PrinterTest, Tree)
+{
+    items[0].path = "/inventory/system/chassis/cpu0";
+    items[1].path = "/inventory/system/dimm1";
+    printer.setFormat(Printer::Format::tree);
+    printer.setRoot("/inventory/system");
+    printer.allowNonPresent();
+    EXPECT_EQ(print(), "system\n"
+                       "  chassis\n"
+                       "    cpu0: CPU, \"main\"\n"
+                       "      Cores:                8\n"
+                       "      Present:              Yes\n"
+                       "      PrettyName:           CPU, \"main\"\n"
+                       "  dimm1: \n"
+                       "    Present:              No\n");
+}
+
+TEST_F(PrinterTest, SubtreeFilter)
+{
+    items[0].path = "/inventory/system/chassis/cpu0";
+    items[1].path = "/inventory/system/dimm1";
+    printer.setRoot("/inventory/system/chassis");
+    printer.allowNonPresent();
+    printer.setFormat(Printer::Format::ndjson);
+    EXPECT_EQ(print(),
+              "{\"name\":\"cpu0\",\"properties\":{\"Cores\":8,"
+              "\"Present\":true,\"PrettyName\":\"CPU, \\\"main\\\"\"}}\n");
+}
+
+TEST_F(PrinterTest, SubtreeRoot)
+{
+    items[0].path = "/inventory/system/chassis/cpu0";
+    items[1].path = "/inventory/system/dimm1";
+    printer.allowNonPresent();
+    printer.setFormat(Printer::Format::csv);
+    const std::string all = print();
+
+    printer.setRoot("/");
+    EXPECT_EQ(print(), all);
+
+    printer.setRoot("/inventory/system/chassis/");
+    EXPECT_EQ(print(), "Item,Property,Value\n"
+                       "cpu0,Cores,8\n"
+                       "cpu0,Present,Yes\n"
+                       "cpu0,PrettyName,\"CPU, \"\"main\"\"\"\n");
+}
+
+TEST_F(PrinterTest, PathFilter)
+{
+    items[0].path = "/inventory/system/chassis/cpu0";
+    printer.setNameFilter("/inventory/system/chassis/cpu0");
+    printer.setFormat(Printer::Format::csv);
+    EXPECT_EQ(print(), "Item,Property,Value\n"
+                       "cpu0,Cores,8\n"
+                       "cpu0,Present,Yes\n"
+                       "cpu0,PrettyName,\"CPU, \"\"main\"\"\"\n");
+}
+
+TEST_F(PrinterTest, Parallel)
+{
+    // enough items for several chunks, with duplicate names and escapes
+    items.clear();
+    for (size_t i = 0; i < 2000; ++i)
+    {
+        InventoryItem item;
+        item.name = "item" + std::to_string(i % 1500);
+        item.properties["Present"] = i % 7 != 0;
+        item.properties["PrettyName"] = std::string("Item\n\"") +
+                                        std::to_string(i) + "\", ok";
+        item.properties["Index"] = uint64_t(i);
+        items.emplace_back(item);
+    }
+
+    for (const Printer::Format format :
+         {Printer::Format::text, Printer::Format::json,
+          Printer::Format::ndjson, Printer::Format::csv})
+    {
+        printer.setFormat(format);
+        printer.setJobs(1);
+        const std::string serial = print();
+        printer.setJobs(4);
+        EXPECT_EQ(print(), serial);
+    }
+}
+
+TEST_F(PrinterTest, Delivery)
+{
+    items.resize(1000, items[0]);
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        items[i].name = "cpu" + std::to_string(i);
+    }
+    printer.setFormat(Printer::Format::text);
+    printer.setJobs(1);
+    const std::string expected = print();
+
+    // source checks output of the first item before passing the rest
+    std::string early;
+    const Printer::Source source = [&](const InventoryHandler& handler) {
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            InventoryItem item = items[i];
+            handler(item);
+            if (i == 0)
+            {
+                early = testing::internal::GetCapturedStdout();
+                testing::internal::CaptureStdout();
+            }
+        }
+    };
+
+    printer.setJobs(4);
+    testing::internal::CaptureStdout();
+    printer.print(source, Printer::Delivery::collect);
+    EXPECT_EQ(early, "");
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), expected);
+
+    testing::internal::CaptureStdout();
+    printer.print(source, Printer::Delivery::flush);
+    EXPECT_EQ(early, expected.substr(0, early.size()));
+    EXPECT_EQ(early.find("cpu1:"), std::string::npos);
+    EXPECT_NE(early, "");
+    EXPECT_EQ(early + testing::internal::GetCapturedStdout(), expected);
+}
+
+TEST_F(PrinterTest, JsonDump)
+{
+    items.emplace_back(items[0]);
+    items.back().properties["Cores"] = uint32_t(4);
+    items.emplace_back(items[0]);
+    items.back().name = "cpu1\n";
+
+    nlohmann::json json = nlohmann::json::object();
+    for (const InventoryItem& item : items)
+    {
+        if (item.isPresent())
+        {
+            nlohmann::json props = nlohmann::json::object();
+            for (const auto& [name, value] : item.properties)
+            {
+                if (name != "SerialNumber")
+                {
+                    std::visit([&](auto&& v) { props.emplace(name, v); },
+                               value);
+                }
+            }
+            json.emplace(item.name, props);
+        }
+    }
+
+    printer.setFormat(Printer::Format::json);
+    EXPECT_EQ(print(), json.dump(2) + '\n');
+}
@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#include "sorter.hpp"
+
+#include <filesystem>
+
+#include <gtest/gtest.h>
+
+/**
+ * @brief Create array of items in reverse human order with duplicates.
+ */
+static std::vector<InventoryItem> makeItems()
+{
+    std::vector<InventoryItem> items;
+    for (size_t i = 0; i < 300; ++i)
+    {
+        InventoryItem item;
+        item.name = "dimm" + std::to_string((300 - i) % 120);
+        item.path = "/inventory/item" + std::to_string(i);
+        item.properties["Index"] = uint64_t(i);
+        item.properties["Present"] = i % 2 == 0;
+        item.properties["PrettyName"] = std::string("DIMM\t\"") +
+                                        std::to_string(i) + "\"\n";
+        items.emplace_back(std::move(item));
+    }
+    return items;
+}
+
+/**
+ * @brief Sort items and collect the result.
+ */
+static std::vector<InventoryItem> sort(ExternalSorter& sorter,
+                                       std::vector<InventoryItem> items)
+{
+    for (InventoryItem& item : items)
+    {
+        sorter.add(std::move(item));
+    }
+    std::vector<InventoryItem> sorted;
+    sorter.merge([&sorted](InventoryItem& item) {
+        sorted.emplace_back(std::move(item));
+    });
+    return sorted;
+}
+
+/**
+ * @brief Check that items are sorted by name in order of arrival.
+ */
+static void checkSorted(const std::vector<InventoryItem>& sorted)
+{
+    ASSERT_EQ(sorted.size(), 300u);
+    for (size_t i = 1; i < sorted.size(); ++i)
+    {
+        const InventoryItem& prev = sorted[i - 1];
+        const InventoryItem& item = sorted[i];
+        ASSERT_FALSE(humanCompare(item.name, prev.name));
+        if (item.name == prev.name)
+        {
+            EXPECT_LT(std::get<uint64_t>(prev.properties.at("Index")),
+                      std::get<uint64_t>(item.properties.at("Index")));
+        }
+    }
+}
+
+TEST(SorterTest, InMemory)
+{
+    ExternalSorter sorter(1 << 30);
+    const std::vector<InventoryItem> sorted = sort(sorter, makeItems());
+    EXPECT_EQ(sorter.runs(), 0u);
+    checkSorted(sorted);
+}
+
+TEST(SorterTest, Spill)
+{
+    ExternalSorter sorter(4096);
+    const std::vector<InventoryItem> sorted = sort(sorter, makeItems());
+    EXPECT_GT(sorter.runs(), 10u);
+    checkSorted(sorted);
+
+    // items are restored as is
+    const std::vector<InventoryItem> items = makeItems();
+    for (const InventoryItem& item : sorted)
+    {
+        const size_t index = std::get<uint64_t>(item.properties.at("Index"));
+        EXPECT_EQ(item.name, items[index].name);
+        EXPECT_EQ(item.path, items[index].path);
+        EXPECT_EQ(item.properties, items[index].properties);
+    }
+}
+
+TEST(SorterTest, MultiPass)
+{
+    // every item is a separate run, merged in several passes
+    ExternalSorter sorter(1);
+    const std::vector<InventoryItem> items = makeItems();
+    for (InventoryItem item : items)
+    {
+        sorter.add(std::move(item));
+    }
+    EXPECT_EQ(sorter.runs(), items.size());
+
+    // runs share the same file
+    size_t fds = 0;
+    for ([[maybe_unused]] const auto& fd :
+         std::filesystem::directory_iterator("/proc/self/fd"))
+    {
+        ++fds;
+    }
+    EXPECT_LT(fds, 16u);
+
+    std::vector<InventoryItem> sorted;
+    sorter.merge([&sorted](InventoryItem& item) {
+        sorted.emplace_back(std::move(item));
+    });
+    checkSorted(sorted);
+    for (const InventoryItem& item : sorted)
+    {
+        const size_t index = std::get<uint64_t>(item.properties.at("Index"));
+        EXPECT_EQ(item.properties, items[index].properties);
+    }
+}
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: Apache-2.0
+// Copyright (C) 2020 YADRO
+
+#include "tree.hpp"
+
+#include <gtest/gtest.h>
+
+TEST(InventoryTreeTest, Walk)
+{
+    // clang-format off
+    const char* paths[] = {
+        "/inventory/system/cpu10",
+        "/inventory/system/cpu1/core10",
+        "/inventory/system/cpu1",
+        "/inventory/system/cpu1/core2",
+        "/inventory/system",
+        "/inventory/system/cpu2",
+    };
+    // ordered list of paths
+    const char* orderedPaths[] = {
+        "/inventory/system",
+        "/inventory/system/cpu1",
+        "/inventory/system/cpu1/core2",
+        "/inventory/system/cpu1/core10",
+        "/inventory/system/cpu2",
+        "/inventory/system/cpu10",
+    };
+    // clang-format on
+
+    InventoryTree tree;
+    for (const char* path : paths)
+    {
+        InventoryItem item;
+        item.path = path;
+        tree.add(std::move(item));
+    }
+
+    std::vector<std::string> walked;
+    tree.walk([&walked](InventoryItem& item) { walked.push_back(item.path); });
+
+    ASSERT_EQ(walked.size(), sizeof(orderedPaths) / sizeof(orderedPaths[0]));
+    for (size_t i = 0; i < walked.size(); ++i)
+    {
+        EXPECT_EQ(walked[i], orderedPaths[i]);
+    }
+}
+
+TEST(InventoryTreeTest, Merge)
+{
+    InventoryItem first;
+    first.path = "/inventory/cpu0";
+    first.properties["Model"] = std::string("Xeon");
+    InventoryItem second;
+    second.path = "/inventory/cpu0";
+    second.properties["Present"] = true;
+
+    InventoryTree tree;
+    tree.add(std::move(first));
+    tree.add(std::move(second));
+
+    size_t count = 0;
+    tree.walk([&count](InventoryItem& item) {
+        ++count;
+        EXPECT_EQ(item.properties.size(), 2u);
+    });
+    EXPECT_EQ(count, 1u);
+}